@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <string.h>
+#include "segment.h"
+#include "alloc.h"
+#include "time.h"
+
+/* connection buffers at different sizes: the send buffer is acknowledged and refilled packet by packet,
+   the receive buffer is filled with packets and drained by small reads, the cost per operation
+   should not depend on the buffer size */
+
+#define SPO_BENCH_PACKET_SIZE 1264
+#define SPO_BENCH_OPERATIONS 2000000
+
+static uint8_t spo_bench_data[SPO_SEGMENT_SIZE];
+
+static double get_nsecs_per_operation(spo_time_t start_time, uint32_t operations)
+{
+    return (double)(spo_time_now() - start_time) * 1000 / operations;
+}
+
+/* the buffer is kept full: each ACK releases a packet at the head and a new one is appended */
+static double run_send(spo_segment_pool_t *pool, uint32_t buf_size)
+{
+    spo_segment_chain_t chain;
+    spo_time_t start_time;
+    uint32_t bytes = 0;
+    uint32_t i;
+
+    spo_segment_chain_init(&chain);
+    while (bytes < buf_size)
+        bytes += spo_segment_chain_write(&chain, pool, bytes, spo_bench_data, SPO_BENCH_PACKET_SIZE, SPO_FALSE);
+
+    start_time = spo_time_now();
+
+    for (i = 0; i < SPO_BENCH_OPERATIONS; ++i)
+    {
+        spo_segment_chain_consume(&chain, pool, SPO_BENCH_PACKET_SIZE);
+        spo_segment_chain_write(&chain, pool, bytes - SPO_BENCH_PACKET_SIZE, spo_bench_data,
+            SPO_BENCH_PACKET_SIZE, SPO_FALSE);
+    }
+
+    spo_segment_chain_destroy(&chain, pool);
+    return get_nsecs_per_operation(start_time, SPO_BENCH_OPERATIONS);
+}
+
+/* the window stays almost full, the reader takes 'read_size' bytes at a time
+   and packets arrive as long as there is room for them */
+static double run_receive(spo_segment_pool_t *pool, uint32_t buf_size, uint32_t read_size)
+{
+    static uint8_t buf[SPO_SEGMENT_SIZE];
+    spo_segment_chain_t chain;
+    spo_time_t start_time;
+    uint32_t bytes = 0;
+    uint32_t i;
+
+    spo_segment_chain_init(&chain);
+    while (bytes + SPO_BENCH_PACKET_SIZE <= buf_size)
+        bytes += spo_segment_chain_write(&chain, pool, bytes, spo_bench_data, SPO_BENCH_PACKET_SIZE, SPO_FALSE);
+
+    start_time = spo_time_now();
+
+    for (i = 0; i < SPO_BENCH_OPERATIONS; ++i)
+    {
+        spo_segment_chain_read(&chain, 0, buf, read_size);
+        spo_segment_chain_consume(&chain, pool, read_size);
+        bytes -= read_size;
+
+        while (bytes + SPO_BENCH_PACKET_SIZE <= buf_size)
+            bytes += spo_segment_chain_write(&chain, pool, bytes, spo_bench_data, SPO_BENCH_PACKET_SIZE, SPO_FALSE);
+    }
+
+    spo_segment_chain_destroy(&chain, pool);
+    return get_nsecs_per_operation(start_time, SPO_BENCH_OPERATIONS);
+}
+
+int main()
+{
+    static const uint32_t buf_sizes[] = { 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024 };
+    static const uint32_t read_sizes[] = { 16, 256, 4096 };
+    uint32_t i;
+    uint32_t j;
+    spo_memory_t memory;
+    spo_segment_pool_t pool;
+
+    spo_memory_init(&memory, NULL);
+    spo_segment_pool_init(&pool, &memory, 0, SPO_FALSE);
+
+    printf("%u operations, ns per ACK and append of a %u bytes packet, ns per read of the given size\n",
+        SPO_BENCH_OPERATIONS, SPO_BENCH_PACKET_SIZE);
+    printf("%-10s %10s", "buffer", "send");
+    for (j = 0; j < sizeof(read_sizes) / sizeof(read_sizes[0]); ++j)
+        printf(" %9u B", read_sizes[j]);
+    printf("\n");
+
+    for (i = 0; i < sizeof(buf_sizes) / sizeof(buf_sizes[0]); ++i)
+    {
+        printf("%7u KB %10.1f", buf_sizes[i] / 1024, run_send(&pool, buf_sizes[i]));
+        for (j = 0; j < sizeof(read_sizes) / sizeof(read_sizes[0]); ++j)
+            printf(" %11.1f", run_receive(&pool, buf_sizes[i], read_sizes[j]));
+        printf("\n");
+    }
+
+    spo_segment_pool_destroy(&pool);
+    return 0;
+}
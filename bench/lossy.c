@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rudp.h"
+#include "udp.h"
+#include "alloc.h"
+#include "time.h"
+
+/* measures redundant retransmissions over a lossy link: the hosts talk through an in-process relay
+   which drops packets at random in both directions and delays the rest, the data go through
+   a bottleneck with a drop-tail queue, so the slow start overshoot leaves many more holes
+   in the window than a single ACK has SACK blocks */
+
+#define SPO_BENCH_TRANSFER_SIZE (8 * 1024 * 1024)
+#define SPO_BENCH_BUF_SIZE (2 * 1024 * 1024)
+#define SPO_BENCH_DELAY_MSECS 20 /* one way */
+#define SPO_BENCH_RATE (8 * 1024 * 1024) /* bytes per second of the bottleneck */
+#define SPO_BENCH_BOTTLENECK_PACKETS 64 /* queued before the bottleneck */
+#define SPO_BENCH_QUEUE_SIZE 4096 /* packets held by the link in each direction */
+#define SPO_BENCH_TIMEOUT_MSECS 60000
+#define SPO_BENCH_BASE_PORT 46100
+
+typedef struct
+{
+    spo_time_t release_time;
+    uint32_t size;
+    uint8_t data[SPO_NET_MAX_PACKET_SIZE];
+} spo_bench_packet_t;
+
+typedef struct
+{
+    spo_bench_packet_t *queue;
+    uint32_t head;
+    uint32_t count;
+    uint32_t rate; /* 0 if unlimited */
+    spo_time_t busy_time; /* the bottleneck is busy with the queued packets up to this time */
+    spo_net_address_t *address;
+} spo_bench_direction_t;
+
+typedef struct
+{
+    spo_net_socket_t socket;
+    spo_net_address_t sender_address; /* learned from the first packet */
+    spo_net_address_t receiver_address;
+    spo_bench_direction_t to_receiver;
+    spo_bench_direction_t to_sender;
+    uint32_t loss_permille;
+} spo_bench_link_t;
+
+typedef struct
+{
+    double seconds;
+    uint64_t bytes_received;
+    uint64_t bytes_retransmitted;
+    uint64_t bytes_duplicate;
+} spo_bench_result_t;
+
+static uint32_t spo_bench_random_state;
+static uint64_t spo_bench_bytes_received;
+
+static uint32_t get_random()
+{
+    spo_bench_random_state = spo_bench_random_state * 1664525 + 1013904223;
+    return spo_bench_random_state >> 8;
+}
+
+static void set_address(spo_net_address_t *address, uint16_t port)
+{
+    memset(address, 0, sizeof(*address));
+    address->type = SPO_NET_SOCKET_TYPE_IPV4;
+    address->address[0] = 127;
+    address->address[3] = 1;
+    address->port = port;
+}
+
+/* the packet is dropped if the queue of the bottleneck is full */
+static void enqueue_packet(spo_bench_direction_t *direction, const uint8_t *data, uint32_t size, spo_time_t now)
+{
+    spo_bench_packet_t *packet = &direction->queue[(direction->head + direction->count) % SPO_BENCH_QUEUE_SIZE];
+    spo_time_t transmission_time;
+
+    if (direction->count == SPO_BENCH_QUEUE_SIZE)
+        return;
+
+    packet->release_time = now;
+
+    if (direction->rate > 0)
+    {
+        transmission_time = (spo_time_t)size * 1000000 / direction->rate;
+
+        if (direction->busy_time < now)
+            direction->busy_time = now;
+        if (direction->busy_time - now > transmission_time * SPO_BENCH_BOTTLENECK_PACKETS)
+            return;
+
+        direction->busy_time += transmission_time;
+        packet->release_time = direction->busy_time;
+    }
+
+    packet->release_time += SPO_TIME_FROM_MSECS(SPO_BENCH_DELAY_MSECS);
+    packet->size = size;
+    memcpy(packet->data, data, size);
+    ++direction->count;
+}
+
+/* the packets of the direction are released in order */
+static void release_packets(spo_bench_link_t *link, spo_bench_direction_t *direction, spo_time_t now)
+{
+    spo_bench_packet_t *packet;
+
+    while (direction->count > 0 && direction->queue[direction->head].release_time <= now)
+    {
+        packet = &direction->queue[direction->head];
+        spo_net_send(link->socket, packet->data, packet->size, direction->address);
+
+        direction->head = (direction->head + 1) % SPO_BENCH_QUEUE_SIZE;
+        --direction->count;
+    }
+}
+
+static void pump_link(spo_bench_link_t *link)
+{
+    uint8_t data[SPO_NET_MAX_PACKET_SIZE];
+    uint32_t size;
+    spo_net_address_t address;
+    spo_bench_direction_t *direction;
+    spo_time_t now = spo_time_now();
+
+    while (spo_net_data_available(link->socket))
+    {
+        size = spo_net_recv(link->socket, data, sizeof(data), &address);
+        if (size == 0)
+            break;
+
+        if (spo_net_equal_addresses(&address, &link->receiver_address))
+        {
+            direction = &link->to_sender;
+        }
+        else
+        {
+            link->sender_address = address;
+            direction = &link->to_receiver;
+        }
+
+        if (get_random() % 1000 >= link->loss_permille)
+            enqueue_packet(direction, data, size, now);
+    }
+
+    release_packets(link, &link->to_receiver, now);
+    release_packets(link, &link->to_sender, now);
+}
+
+static void incoming_data(spo_host_t host, spo_connection_t connection, uint32_t data_size)
+{
+    static uint8_t buf[65536];
+    uint32_t size;
+
+    while ((size = spo_read(connection, buf, sizeof(buf))) > 0)
+        spo_bench_bytes_received += size;
+}
+
+static void ignore_event(spo_host_t host, spo_connection_t connection)
+{
+}
+
+static void init_configuration(spo_configuration *configuration, uint32_t receive_bitmap)
+{
+    memset(configuration, 0, sizeof(*configuration));
+
+    configuration->initial_cwnd_in_packets = 2;
+    configuration->cwnd_on_timeout_in_packets = 2;
+    configuration->min_ssthresh_in_packets = 4;
+    configuration->max_cwnd_inc_on_slowstart_in_packets = 50;
+    configuration->duplicate_acks_for_retransmit = 2;
+    configuration->ssthresh_factor_on_timeout_percent = 50;
+    configuration->ssthresh_factor_on_loss_percent = 70;
+    configuration->connection_buf_size = SPO_BENCH_BUF_SIZE;
+    configuration->socket_buf_size = 1048576 * 8;
+    configuration->max_connections = 4;
+    configuration->connection_timeout = 8000;
+    configuration->ping_interval = 100;
+    configuration->connect_retransmission_timeout = 500;
+    configuration->max_connect_attempts = 10;
+    configuration->accept_retransmission_timeout = 500;
+    configuration->max_accepted_attempts = 10;
+    configuration->data_retransmission_timeout = 600;
+    configuration->max_consecutive_acknowledges = 10;
+    configuration->hibernation_timeout = 30000;
+    configuration->receive_bitmap = receive_bitmap;
+}
+
+static spo_bool_t run_transfer(uint32_t loss_permille, uint32_t receive_bitmap, spo_memory_t *memory,
+    spo_bench_result_t *result)
+{
+    static uint8_t buf[65536];
+    spo_net_address_t sender_address;
+    spo_net_address_t receiver_address;
+    spo_net_address_t link_address;
+    spo_configuration configuration;
+    spo_callbacks_t callbacks;
+    spo_host_statistics_t sender_statistics;
+    spo_host_statistics_t receiver_statistics;
+    spo_bench_link_t link;
+    spo_host_t sender;
+    spo_host_t receiver;
+    spo_connection_t connection;
+    uint64_t bytes_sent = 0;
+    spo_time_t start_time;
+    uint32_t i;
+
+    set_address(&sender_address, SPO_BENCH_BASE_PORT);
+    set_address(&receiver_address, SPO_BENCH_BASE_PORT + 1);
+    set_address(&link_address, SPO_BENCH_BASE_PORT + 2);
+
+    for (i = 0; i < sizeof(buf); ++i)
+        buf[i] = (uint8_t)i;
+
+    callbacks.unable_to_connect = ignore_event;
+    callbacks.connected = ignore_event;
+    callbacks.incoming_connection = ignore_event;
+    callbacks.incoming_data = incoming_data;
+    callbacks.connection_lost = ignore_event;
+
+    init_configuration(&configuration, receive_bitmap);
+
+    memset(&link, 0, sizeof(link));
+    link.receiver_address = receiver_address;
+    link.loss_permille = loss_permille;
+    link.to_receiver.queue = (spo_bench_packet_t *)malloc(SPO_BENCH_QUEUE_SIZE * sizeof(spo_bench_packet_t));
+    link.to_receiver.rate = SPO_BENCH_RATE;
+    link.to_receiver.address = &link.receiver_address;
+    link.to_sender.queue = (spo_bench_packet_t *)malloc(SPO_BENCH_QUEUE_SIZE * sizeof(spo_bench_packet_t));
+    link.to_sender.address = &link.sender_address;
+    link.socket = spo_net_new_socket(&link_address, configuration.socket_buf_size, memory);
+
+    sender = spo_new_host(&sender_address, &configuration, &callbacks);
+    receiver = spo_new_host(&receiver_address, &configuration, &callbacks);
+
+    if (link.to_receiver.queue == NULL || link.to_sender.queue == NULL || link.socket == NULL ||
+        sender == NULL || receiver == NULL)
+        return SPO_FALSE;
+
+    spo_bench_random_state = 0x9E3779B9;
+    spo_bench_bytes_received = 0;
+    start_time = spo_time_now();
+
+    connection = spo_new_connection(sender, &link_address);
+
+    while (spo_bench_bytes_received < SPO_BENCH_TRANSFER_SIZE &&
+        spo_time_now() - start_time < SPO_TIME_FROM_MSECS(SPO_BENCH_TIMEOUT_MSECS))
+    {
+        if (connection != NULL && bytes_sent < SPO_BENCH_TRANSFER_SIZE &&
+            spo_get_connection_state(connection) == SPO_CONNECTION_STATE_CONNECTED)
+        {
+            uint32_t size = (uint32_t)SPO_MIN(sizeof(buf), SPO_BENCH_TRANSFER_SIZE - bytes_sent);
+            bytes_sent += spo_send(connection, buf, size);
+        }
+
+        spo_make_progress(sender);
+        pump_link(&link);
+        spo_make_progress(receiver);
+        pump_link(&link);
+    }
+
+    result->seconds = (double)(spo_time_now() - start_time) / 1000000;
+    result->bytes_received = spo_bench_bytes_received;
+
+    spo_get_host_statistics(sender, &sender_statistics);
+    spo_get_host_statistics(receiver, &receiver_statistics);
+    result->bytes_retransmitted = sender_statistics.data_bytes_retransmitted;
+    result->bytes_duplicate = receiver_statistics.duplicate_bytes_received;
+
+    if (connection != NULL)
+        spo_close_connection(connection);
+    spo_close_host(sender);
+    spo_close_host(receiver);
+    spo_net_close_socket(link.socket);
+    free(link.to_receiver.queue);
+    free(link.to_sender.queue);
+
+    return SPO_TRUE;
+}
+
+int main()
+{
+    static const uint32_t losses_permille[] = { 0, 1, 5, 10, 20 };
+    static const char *scoreboards[] = { "index", "bitmap" };
+    uint32_t i;
+    uint32_t receive_bitmap;
+    spo_memory_t memory;
+    spo_bench_result_t result;
+
+    if (!spo_init())
+        return 1;
+
+    spo_memory_init(&memory, NULL);
+
+    printf("%u MB through a %u MB/s link with %u ms one way delay and %u packets queue, %u KB buffers,\n"
+        "bytes are in %% of the transfer\n", SPO_BENCH_TRANSFER_SIZE / (1024 * 1024), SPO_BENCH_RATE / (1024 * 1024),
+        SPO_BENCH_DELAY_MSECS, SPO_BENCH_BOTTLENECK_PACKETS, SPO_BENCH_BUF_SIZE / 1024);
+    printf("%-8s %-8s %8s %8s %14s %10s\n", "loss", "receiver", "seconds", "MB/s", "retransmitted", "duplicate");
+
+    for (i = 0; i < sizeof(losses_permille) / sizeof(losses_permille[0]); ++i)
+    {
+        for (receive_bitmap = 0; receive_bitmap < 2; ++receive_bitmap)
+        {
+            if (!run_transfer(losses_permille[i], receive_bitmap, &memory, &result))
+            {
+                printf("can't create the hosts\n");
+                return 1;
+            }
+
+            printf("%5.1f%%   %-8s %8.2f %8.2f %13.2f%% %9.2f%%%s\n", losses_permille[i] / 10.0,
+                scoreboards[receive_bitmap], result.seconds, result.bytes_received / result.seconds / (1024 * 1024),
+                100.0 * result.bytes_retransmitted / SPO_BENCH_TRANSFER_SIZE,
+                100.0 * result.bytes_duplicate / SPO_BENCH_TRANSFER_SIZE,
+                result.bytes_received < SPO_BENCH_TRANSFER_SIZE ? " INCOMPLETE" : "");
+            fflush(stdout);
+        }
+    }
+
+    spo_shutdown();
+    return 0;
+}
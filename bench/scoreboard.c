@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "index.h"
+#include "bitmap.h"
+#include "packet.h"
+#include "time.h"
+
+/* compares the receive scoreboards: sorted intervals against the bitmap,
+   packets arrive with random loss (retransmitted later) and reordering,
+   each packet is measured with and without gathering the SACK blocks for an ACK */
+
+#define SPO_BENCH_WINDOW_SIZE (4 * 1024 * 1024)
+#define SPO_BENCH_PACKET_SIZE 1400
+#define SPO_BENCH_PACKETS 200000
+#define SPO_BENCH_RETRANSMIT_DELAY 1000 /* in packets, about one RTT of a large window */
+
+typedef struct
+{
+    uint32_t key; /* arrival order */
+    uint32_t seq;
+} spo_bench_arrival_t;
+
+typedef struct
+{
+    const char *name;
+    uint32_t loss_percent;
+    uint32_t reorder_percent;
+    uint32_t reorder_distance; /* in packets */
+} spo_bench_scenario_t;
+
+typedef struct
+{
+    uint64_t usecs;
+    uint64_t bytes_delivered;
+    uint64_t sacks_checksum;
+    uint32_t max_ranges;
+} spo_bench_result_t;
+
+static uint32_t spo_bench_random_state = 0x9E3779B9;
+
+static uint32_t spo_bench_random()
+{
+    /* xorshift, so every run gets the same arrivals */
+    spo_bench_random_state ^= spo_bench_random_state << 13;
+    spo_bench_random_state ^= spo_bench_random_state >> 17;
+    spo_bench_random_state ^= spo_bench_random_state << 5;
+    return spo_bench_random_state;
+}
+
+static int compare_arrivals(const void *a, const void *b)
+{
+    const spo_bench_arrival_t *first = (const spo_bench_arrival_t *)a;
+    const spo_bench_arrival_t *second = (const spo_bench_arrival_t *)b;
+
+    if (first->key != second->key)
+        return first->key < second->key ? -1 : 1;
+    return first->seq < second->seq ? -1 : (first->seq > second->seq ? 1 : 0);
+}
+
+static void make_arrivals(spo_bench_arrival_t *arrivals, const spo_bench_scenario_t *scenario, uint32_t start_seq)
+{
+    uint32_t i;
+
+    for (i = 0; i < SPO_BENCH_PACKETS; ++i)
+    {
+        /* keys are scaled, so a delayed packet goes after the ones sent at the same time */
+        arrivals[i].key = i * 4;
+        arrivals[i].seq = start_seq + i * SPO_BENCH_PACKET_SIZE;
+
+        if (spo_bench_random() % 100 < scenario->loss_percent)
+            arrivals[i].key += SPO_BENCH_RETRANSMIT_DELAY * 4 + 1;
+        else if (scenario->reorder_distance > 0 && spo_bench_random() % 100 < scenario->reorder_percent)
+            arrivals[i].key += (1 + spo_bench_random() % scenario->reorder_distance) * 4 + 2;
+    }
+
+    qsort(arrivals, SPO_BENCH_PACKETS, sizeof(spo_bench_arrival_t), compare_arrivals);
+}
+
+static void run_index(const spo_bench_arrival_t *arrivals, uint32_t start_seq, uint32_t max_sacks,
+    spo_memory_t *memory, spo_bench_result_t *result)
+{
+    uint32_t i;
+    uint32_t count;
+    uint32_t packet_end;
+    uint32_t expected_seq = start_seq;
+    spo_index_t index;
+    spo_index_item_t *current;
+    spo_time_t start_time = spo_time_now();
+
+    spo_index_init(&index, memory);
+
+    for (i = 0; i < SPO_BENCH_PACKETS; ++i)
+    {
+        spo_index_merge_item(&index, arrivals[i].seq, SPO_BENCH_PACKET_SIZE);
+
+        if (index.length > result->max_ranges)
+            result->max_ranges = index.length;
+
+        /* the same walk as the receiver does for the new in-order data */
+        current = SPO_INDEX_FIRST(&index);
+        while (SPO_INDEX_VALID(&index, current))
+        {
+            packet_end = current->start + current->size;
+            if ((int32_t)(expected_seq - current->start) < 0)
+                break;
+            if ((int32_t)(expected_seq - packet_end) < 0)
+            {
+                result->bytes_delivered += packet_end - expected_seq;
+                expected_seq = packet_end;
+            }
+            current = spo_index_remove_item(&index, current);
+        }
+
+        current = SPO_INDEX_FIRST(&index);
+        for (count = 0; count < max_sacks && SPO_INDEX_VALID(&index, current); ++count)
+        {
+            result->sacks_checksum += current->start ^ current->size;
+            current = SPO_INDEX_NEXT(&index, current);
+        }
+    }
+
+    result->usecs = spo_time_now() - start_time;
+    spo_index_destroy(&index);
+}
+
+static void run_bitmap(const spo_bench_arrival_t *arrivals, uint32_t start_seq, uint32_t max_sacks,
+    spo_memory_t *memory, spo_bench_result_t *result)
+{
+    uint32_t i;
+    uint32_t count;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t bytes_received;
+    uint32_t win_start_seq = start_seq;
+    spo_bitmap_t bitmap;
+    spo_time_t start_time = spo_time_now();
+
+    spo_bitmap_init(&bitmap, memory, SPO_BENCH_WINDOW_SIZE);
+
+    for (i = 0; i < SPO_BENCH_PACKETS; ++i)
+    {
+        spo_bitmap_set_range(&bitmap, arrivals[i].seq - win_start_seq, SPO_BENCH_PACKET_SIZE);
+
+        bytes_received = spo_bitmap_consume_prefix(&bitmap);
+        result->bytes_delivered += bytes_received;
+        win_start_seq += bytes_received;
+
+        offset = 0;
+        for (count = 0; count < max_sacks && spo_bitmap_find_run(&bitmap, &offset, &size); ++count)
+        {
+            result->sacks_checksum += (win_start_seq + offset) ^ size;
+            offset += size;
+        }
+    }
+
+    result->usecs = spo_time_now() - start_time;
+    spo_bitmap_destroy(&bitmap);
+}
+
+static double get_nsecs_per_packet(const spo_bench_result_t *result)
+{
+    return result->usecs * 1000.0 / SPO_BENCH_PACKETS;
+}
+
+int main()
+{
+    static const spo_bench_scenario_t scenarios[] =
+    {
+        { "in order", 0, 0, 0 },
+        { "loss 1%", 1, 0, 0 },
+        { "loss 1%, reorder 10%", 1, 10, 16 },
+        { "loss 5%, reorder 30%", 5, 30, 64 },
+        { "loss 10%, reorder 50%", 10, 50, 256 },
+        { "loss 30%, reorder 90%", 30, 90, 1024 },
+        { "reorder 90%, far", 0, 90, 2500 }
+    };
+    uint32_t i;
+    uint32_t sacks;
+    uint32_t start_seq = 0xFFFF0000; /* the sequence space wraps during the run */
+    spo_memory_t memory;
+    spo_bench_result_t index_results[2];
+    spo_bench_result_t bitmap_results[2];
+    spo_bench_arrival_t *arrivals = (spo_bench_arrival_t *)malloc(SPO_BENCH_PACKETS * sizeof(spo_bench_arrival_t));
+
+    if (arrivals == NULL)
+        return 1;
+
+    spo_memory_init(&memory, NULL);
+
+    printf("%u packets of %u bytes, %u KB window, ns per packet without and with %u SACK blocks\n",
+        SPO_BENCH_PACKETS, SPO_BENCH_PACKET_SIZE, SPO_BENCH_WINDOW_SIZE / 1024, SPO_PACKET_MAX_SACKS);
+    printf("%-24s %8s %8s %8s %8s %8s\n", "scenario", "index", "bitmap", "index", "bitmap", "ranges");
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i)
+    {
+        make_arrivals(arrivals, &scenarios[i], start_seq);
+
+        memset(index_results, 0, sizeof(index_results));
+        memset(bitmap_results, 0, sizeof(bitmap_results));
+
+        for (sacks = 0; sacks < 2; ++sacks)
+        {
+            run_index(arrivals, start_seq, sacks * SPO_PACKET_MAX_SACKS, &memory, &index_results[sacks]);
+            run_bitmap(arrivals, start_seq, sacks * SPO_PACKET_MAX_SACKS, &memory, &bitmap_results[sacks]);
+        }
+
+        printf("%-24s %8.1f %8.1f %8.1f %8.1f %8u%s\n", scenarios[i].name,
+            get_nsecs_per_packet(&index_results[0]), get_nsecs_per_packet(&bitmap_results[0]),
+            get_nsecs_per_packet(&index_results[1]), get_nsecs_per_packet(&bitmap_results[1]),
+            index_results[0].max_ranges,
+            (index_results[1].bytes_delivered != bitmap_results[1].bytes_delivered ||
+            index_results[1].sacks_checksum != bitmap_results[1].sacks_checksum) ? " MISMATCH" : "");
+    }
+
+    free(arrivals);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SPO_ALLOC_H
+#define SPO_ALLOC_H
+
+#include "pstdint.h"
+#include "common.h"
+
+/* user-defined allocator, sizes are passed back to make arena allocators simple */
+typedef struct
+{
+    void *(*alloc)(void *context, size_t size);
+    void *(*realloc)(void *context, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(void *context, void *ptr, size_t size);
+    void *context;
+} spo_allocator_t;
+
+typedef struct
+{
+    uint64_t allocations;
+    uint64_t reallocations;
+    uint64_t deallocations;
+    uint64_t bytes_in_use;
+} spo_memory_counters_t;
+
+typedef struct
+{
+    spo_allocator_t allocator;
+    spo_memory_counters_t counters;
+} spo_memory_t;
+
+void spo_memory_init(spo_memory_t *memory, const spo_allocator_t *allocator);
+void *spo_memory_alloc(spo_memory_t *memory, size_t size);
+void *spo_memory_realloc(spo_memory_t *memory, void *ptr, size_t old_size, size_t new_size);
+void spo_memory_free(spo_memory_t *memory, void *ptr, size_t size);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef SPO_BITMAP_H
+#define SPO_BITMAP_H
+
+#include "pstdint.h"
+#include "common.h"
+#include "alloc.h"
+
+/* ring of bits over a sliding window, bit 0 is the first position of the window,
+   the summary levels let the scans skip the long runs of the clear and the set bits */
+typedef struct
+{
+    uint64_t *words; /* NULL until a bit is set after a hole, the bits are followed by the summaries */
+    uint32_t size; /* in bits, power of two */
+    uint32_t head; /* position of the first bit of the window */
+    uint32_t prefix; /* set bits at the window start, they are only counted and never stored */
+    uint32_t length; /* bits of the window up to the last set one */
+    uint32_t window_size; /* in bits */
+    spo_memory_t *memory;
+} spo_bitmap_t;
+
+void spo_bitmap_init(spo_bitmap_t *bitmap, spo_memory_t *memory, uint32_t window_size);
+void spo_bitmap_destroy(spo_bitmap_t *bitmap);
+/* offset is relative to the window start, fails if the bits don't fit into the window */
+spo_bool_t spo_bitmap_set_range(spo_bitmap_t *bitmap, uint32_t offset, uint32_t count);
+/* moves the window after the set bits at its start, returns their count */
+uint32_t spo_bitmap_consume_prefix(spo_bitmap_t *bitmap);
+/* finds the run of set bits which contains '*offset', returns SPO_FALSE if the bit is clear */
+spo_bool_t spo_bitmap_get_run(const spo_bitmap_t *bitmap, uint32_t *offset, uint32_t *count);
+/* finds the first run of set bits at or after '*offset', returns SPO_FALSE if there is none */
+spo_bool_t spo_bitmap_find_run(const spo_bitmap_t *bitmap, uint32_t *offset, uint32_t *count);
+
+#endif
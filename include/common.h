@@ -33,4 +33,15 @@ typedef unsigned int spo_bool_t;
 #define SPO_INLINE static inline
 #endif
 
+#define SPO_MIN(x, y) ((x) < (y) ? (x) : (y))
+#define SPO_MAX(x, y) ((x) > (y) ? (x) : (y))
+
+#define SPO_CACHE_LINE_SIZE 64
+
+#ifdef _MSC_VER
+#define SPO_CACHE_ALIGNED __declspec(align(64))
+#else
+#define SPO_CACHE_ALIGNED __attribute__((aligned(SPO_CACHE_LINE_SIZE)))
+#endif
+
 #endif
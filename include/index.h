@@ -25,28 +25,38 @@ THE SOFTWARE.
 
 #include "pstdint.h"
 #include "common.h"
+#include "alloc.h"
 
+#define SPO_INDEX_INLINE_SIZE 4
+
+/* interval of the sequence space, items are sorted by 'start' */
 typedef struct
 {
-    uint32_t key;
-    void *data;
+    uint32_t start;
+    uint32_t size;
 } spo_index_item_t;
 
 typedef struct
 {
-    spo_index_item_t *items;
+    spo_index_item_t *items; /* first item, NULL until the first item is inserted */
     uint32_t length;
     uint32_t size; /* allocated size */
+    uint32_t offset; /* free items before the first one, the head is removed without moving the rest */
+    spo_memory_t *memory;
+    spo_index_item_t inline_items[SPO_INDEX_INLINE_SIZE]; /* small indices don't allocate memory */
 } spo_index_t;
 
 #define SPO_INDEX_FIRST(index) ((index)->items)
 #define SPO_INDEX_NEXT(index, current) ((current) + 1)
 #define SPO_INDEX_VALID(index, current) ((current) < (index)->items + (index)->length) /* fails if index is empty */
 
-void spo_index_init(spo_index_t *index);
+void spo_index_init(spo_index_t *index, spo_memory_t *memory);
 void spo_index_destroy(spo_index_t *index);
-spo_index_item_t *spo_index_find_pos_by_key(spo_index_t *index, uint32_t key);
-spo_index_item_t *spo_index_insert_item_after(spo_index_t *index, spo_index_item_t *after_item, uint32_t key, void *data);
+void spo_index_clear(spo_index_t *index); /* keeps the allocated memory */
+spo_index_item_t *spo_index_find_pos_by_key(spo_index_t *index, uint32_t start);
+spo_index_item_t *spo_index_insert_item_after(spo_index_t *index, spo_index_item_t *after_item, uint32_t start, uint32_t size);
 spo_index_item_t *spo_index_remove_item(spo_index_t *index, spo_index_item_t *item);
+/* inserts the interval and merges it with the overlapping and adjacent ones */
+spo_bool_t spo_index_merge_item(spo_index_t *index, uint32_t start, uint32_t size);
 
 #endif
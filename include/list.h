@@ -25,6 +25,7 @@ THE SOFTWARE.
 
 #include "pstdint.h"
 #include "common.h"
+#include "slab.h"
 
 typedef struct spo_list_item
 {
@@ -38,13 +39,14 @@ typedef struct
     spo_list_item_t *head;
     spo_list_item_t *tail;
     uint32_t length;
+    spo_slab_t *slab; /* allocator of the list items */
 } spo_list_t;
 
 #define SPO_LIST_FIRST(list) ((list)->head)
 #define SPO_LIST_NEXT(list, current) ((current)->next_item)
 #define SPO_LIST_VALID(list, current) ((current) != NULL)
 
-void spo_list_init(spo_list_t *list);
+void spo_list_init(spo_list_t *list, spo_slab_t *slab);
 void spo_list_destroy(spo_list_t *list);
 spo_list_item_t *spo_list_add_item(spo_list_t *list, void *data);
 spo_list_item_t *spo_list_remove_item(spo_list_t *list, spo_list_item_t *item);
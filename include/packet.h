@@ -36,6 +36,8 @@ typedef enum
     SPO_PACKET_ACK, /* ack only */
     SPO_PACKET_PING, /* ping */
     SPO_PACKET_DATA, /* contains data */
+    SPO_PACKET_CHALLENGE, /* validates the new address of the other side, SEQ is a nonce */
+    SPO_PACKET_RESPONSE, /* echoes the nonce of CHALLENGE from the new address */
 
     SPO_PACKET_TYPES_COUNT
 } spo_packet_type_t;
@@ -27,5 +27,6 @@ THE SOFTWARE.
 
 void spo_random_init();
 uint32_t spo_random_next();
+void spo_random_fill(uint8_t *buf, uint32_t size); /* for secret keys, uses the system source if available */
 
 #endif
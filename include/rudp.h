@@ -26,9 +26,11 @@ THE SOFTWARE.
 #include "common.h"
 #include "pstdint.h"
 #include "udp.h"
+#include "alloc.h"
 
 typedef void *spo_host_t;
 typedef void *spo_connection_t;
+typedef void *spo_pool_t;
 
 typedef enum
 {
@@ -51,6 +53,20 @@ typedef struct
     void (*connection_lost)(spo_host_t host, spo_connection_t connection); /* for recently established connections */
 } spo_callbacks_t;
 
+/* element of the buffers vector of spo_sendv() and spo_readv(), also a span of spo_peek() */
+typedef struct
+{
+    uint8_t *data;
+    uint32_t size;
+} spo_buffer_t;
+
+/* the buffer of spo_send_zc() is released when all its data are acknowledged or when the connection is closed,
+   'delivered' is SPO_FALSE in the latter case */
+typedef void (*spo_send_completion_t)(spo_connection_t connection, void *context, spo_bool_t delivered);
+/* the buffer of spo_post_receive() is released when it's filled or when the connection is closed,
+   'filled' is SPO_FALSE in the latter case */
+typedef void (*spo_receive_completion_t)(spo_connection_t connection, void *context, spo_bool_t filled);
+
 typedef struct
 {
     uint32_t connection_buf_size; /* 65536 is recommended */
@@ -65,6 +81,7 @@ typedef struct
     uint32_t ssthresh_factor_on_loss_percent; /* 70 is recommended */
 
     uint32_t max_connections; /* 500 is recommended */
+    uint32_t preallocate_connections; /* 0 is recommended, 1 pre-warms pools up to 'max_connections' */
     uint32_t connection_timeout; /* 8000 is recommended */
     uint32_t ping_interval; /* 1500 is recommended */
     uint32_t connect_retransmission_timeout; /* 2000 is recommended */
@@ -74,24 +91,104 @@ typedef struct
     uint32_t data_retransmission_timeout; /* 600 is recommended */
     uint32_t skip_packets_before_acknowledgement; /* 0 is recommended */
     uint32_t max_consecutive_acknowledges; /* 10 is recommended */
+    uint32_t hibernation_timeout; /* 30000 is recommended, 0 disables hibernation of idle connections */
+    uint64_t buffers_memory_limit; /* 0 is recommended (no limit), shared by the buffers of all connections */
+    uint32_t use_hugepages; /* 0 is recommended, 1 maps the buffers memory with hugepages if the system allows */
+    uint32_t connect_cookies_threshold; /* 64 is recommended, half-open connections before CONNECTs are answered statelessly, 0 disables */
+    uint32_t max_resets_per_second; /* 1000 is recommended, 0 disables the limit */
+    uint32_t max_resets_per_source; /* 10 is recommended, per second for each source address, 0 disables the limit */
+    uint32_t max_connects_per_source; /* 10 is recommended, per second for each source address, 0 disables the limit */
+    uint32_t max_connects_per_second; /* 1000 is recommended, pace of the outgoing CONNECTs, 0 disables the limit */
+    uint32_t max_connects_in_flight; /* 64 is recommended, outgoing handshakes at the same time, 0 disables the limit */
+    uint32_t allow_migration; /* 1 is recommended, connections follow the other side to its validated new address */
+    uint32_t receive_bitmap; /* 0 is recommended, 1 tracks out-of-order data with 1 bit per byte of the buffer, for large buffers with heavy reordering */
 } spo_configuration;
 
+typedef struct
+{
+    /* host allocator activity, steady-state data transfer should not change allocation counters */
+    uint64_t allocations;
+    uint64_t reallocations;
+    uint64_t deallocations;
+    uint64_t bytes_in_use;
+
+    /* connection buffers pool */
+    uint64_t buffers_bytes_allocated;
+    uint64_t buffers_bytes_in_use;
+
+    /* stateless handshake */
+    uint64_t connect_cookies_sent;
+    uint64_t connect_cookies_accepted;
+
+    /* overload protection */
+    uint64_t resets_dropped; /* RESETs not sent because of the rate limits */
+    uint64_t connects_dropped; /* CONNECTs ignored because of the rate limits */
+
+    /* connection migration */
+    uint64_t migration_challenges_sent;
+    uint64_t connections_migrated;
+
+    /* data transfer */
+    uint64_t data_bytes_retransmitted; /* data sent again after a loss or a timeout */
+    uint64_t duplicate_bytes_received; /* data received once more, mostly redundant retransmissions */
+} spo_host_statistics_t;
+
 typedef void (*logger_ptr_t)(const char *message);
 
 spo_bool_t spo_init();
 void spo_shutdown();
 void spo_set_logger(logger_ptr_t logger);
+void spo_set_allocator(const spo_allocator_t *allocator); /* used by the hosts created afterwards, NULL or a missing hook restores the default one */
 
 spo_host_t spo_new_host(const spo_net_address_t *bind_address, const spo_configuration *configuration, const spo_callbacks_t *callbacks);
-void spo_close_host(spo_host_t host);
-spo_bool_t spo_make_progress(spo_host_t host);
+void spo_close_host(spo_host_t host); /* resets the connections, except the exported ones */
+spo_bool_t spo_make_progress(spo_host_t host); /* returns SPO_TRUE if some work is done */
+/* 0 packets means the default budget, 0 usecs means no time limit,
+   returns SPO_TRUE if the work remains after the budget is spent */
+spo_bool_t spo_make_progress_budget(spo_host_t host, uint32_t max_packets, uint32_t max_usecs);
+void spo_get_host_statistics(spo_host_t host, spo_host_statistics_t *statistics);
+/* returns count of the established connections, no more than 'max_count' of them are stored */
+uint32_t spo_get_connections(spo_host_t host, spo_connection_t *connections, uint32_t max_count);
+
+/* live upgrade: established connections continue in another process without a handshake,
+   connections in the other states and idle pooled ones are not transferred */
+uint32_t spo_export_host(spo_host_t host, uint8_t *buf, uint32_t buf_size); /* returns state size, writes it only if it fits */
+spo_bool_t spo_import_host(spo_host_t host, const uint8_t *buf, uint32_t buf_size); /* the host must have no connections */
+/* sends the socket and the state over a connected unix domain stream socket, closes the host on success */
+spo_bool_t spo_handoff_host(spo_host_t host, int unix_socket);
+spo_host_t spo_take_over_host(int unix_socket, const spo_configuration *configuration, const spo_callbacks_t *callbacks);
 
 spo_connection_t spo_new_connection(spo_host_t host, const spo_net_address_t *host_address);
+/* starts 'count' connections, failed ones are NULL in 'connections', returns count of the started connections */
+uint32_t spo_new_connections(spo_host_t host, const spo_net_address_t *host_addresses, uint32_t count,
+    spo_connection_t *connections);
+
+/* pool keeps 'size' idle connections established to the address, they don't fire any events until checked out */
+spo_pool_t spo_new_pool(spo_host_t host, const spo_net_address_t *host_address, uint32_t size);
+void spo_close_pool(spo_pool_t pool); /* closes the idle connections, checked out ones stay open */
+spo_connection_t spo_checkout_connection(spo_pool_t pool); /* returns NULL if no connection is established yet */
+void spo_checkin_connection(spo_pool_t pool, spo_connection_t connection); /* closes the connection if it isn't needed */
+
 spo_connection_state_t spo_get_connection_state(spo_connection_t connection);
 spo_bool_t spo_get_remote_address(spo_connection_t connection, spo_net_address_t *host_address);
 void spo_close_connection(spo_connection_t connection);
 
 uint32_t spo_send(spo_connection_t connection, const uint8_t *buf, uint32_t buf_size);
+/* sends the data without copying them, the buffer must stay unchanged until 'completion' is called,
+   returns count of the accepted bytes, 'completion' is called only if some bytes are accepted */
+uint32_t spo_send_zc(spo_connection_t connection, const uint8_t *buf, uint32_t buf_size,
+    spo_send_completion_t completion, void *context);
 uint32_t spo_read(spo_connection_t connection, uint8_t *buf, uint32_t buf_size);
+/* returns count of the spans of the ready data stored in place, they stay valid until the data are consumed or read,
+   spo_consume() releases the data without copying and returns count of the released bytes */
+uint32_t spo_peek(spo_connection_t connection, spo_buffer_t *spans, uint32_t max_spans);
+uint32_t spo_consume(spo_connection_t connection, uint32_t size);
+/* gather and scatter versions of spo_send() and spo_read(), the buffers are processed in order */
+uint32_t spo_sendv(spo_connection_t connection, const spo_buffer_t *buffers, uint32_t count);
+uint32_t spo_readv(spo_connection_t connection, const spo_buffer_t *buffers, uint32_t count);
+/* the posted buffer takes the next data after the ones read or posted before, including the data received already,
+   incoming data are placed into it directly and can't be read, returns SPO_FALSE if the buffer isn't posted */
+spo_bool_t spo_post_receive(spo_connection_t connection, uint8_t *buf, uint32_t buf_size,
+    spo_receive_completion_t completion, void *context);
 
 #endif
@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SPO_SEGMENT_H
+#define SPO_SEGMENT_H
+
+#include "pstdint.h"
+#include "common.h"
+#include "alloc.h"
+
+#define SPO_SEGMENT_SIZE 4096
+
+typedef struct spo_segment_chunk
+{
+    struct spo_segment_chunk *next_chunk;
+    size_t size; /* size of the whole chunk in bytes */
+    spo_bool_t huge; /* chunk is mapped with hugepages */
+} spo_segment_chunk_t;
+
+/* host-wide pool of the fixed-size segments shared by all connection buffers */
+typedef struct
+{
+    spo_memory_t *memory;
+    void *free_segments; /* singly linked list of free segments */
+    spo_segment_chunk_t *chunks;
+    uint32_t segments_allocated; /* total segments in all chunks */
+    uint32_t segments_used;
+    uint32_t max_segments; /* zero means no limit */
+    uint32_t reserved_segments; /* can be used only by allocations which guarantee progress */
+    spo_bool_t use_hugepages;
+} spo_segment_pool_t;
+
+/* byte stream stored in the segments, segments for the missing data may be absent,
+   the segments form a ring, so the consumed ones are released without moving the rest */
+typedef struct
+{
+    uint8_t **segments;
+    uint32_t head; /* index of the first segment in 'segments' */
+    uint32_t count; /* segments covered by the stream */
+    uint32_t size; /* allocated size of 'segments' array, power of two */
+    uint32_t head_offset; /* position of the first byte in the first segment */
+} spo_segment_chain_t;
+
+void spo_segment_pool_init(spo_segment_pool_t *pool, spo_memory_t *memory, uint64_t max_bytes, spo_bool_t use_hugepages);
+void spo_segment_pool_destroy(spo_segment_pool_t *pool);
+uint8_t *spo_segment_alloc(spo_segment_pool_t *pool, spo_bool_t use_reserve);
+void spo_segment_free(spo_segment_pool_t *pool, uint8_t *segment);
+
+void spo_segment_chain_init(spo_segment_chain_t *chain);
+void spo_segment_chain_destroy(spo_segment_chain_t *chain, spo_segment_pool_t *pool);
+uint32_t spo_segment_chain_write(spo_segment_chain_t *chain, spo_segment_pool_t *pool,
+    uint32_t offset, const uint8_t *data, uint32_t data_size, spo_bool_t use_reserve);
+void spo_segment_chain_read(const spo_segment_chain_t *chain, uint32_t offset, uint8_t *data, uint32_t data_size);
+/* returns the data at 'offset' in place, 'data_size' is reduced to the bytes stored contiguously */
+uint8_t *spo_segment_chain_get_data(const spo_segment_chain_t *chain, uint32_t offset, uint32_t *data_size);
+void spo_segment_chain_consume(spo_segment_chain_t *chain, spo_segment_pool_t *pool, uint32_t bytes);
+void spo_segment_chain_clear(spo_segment_chain_t *chain, spo_segment_pool_t *pool);
+
+#endif
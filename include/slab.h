@@ -0,0 +1,55 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SPO_SLAB_H
+#define SPO_SLAB_H
+
+#include "pstdint.h"
+#include "common.h"
+#include "alloc.h"
+
+typedef struct spo_slab_chunk
+{
+    struct spo_slab_chunk *next_chunk;
+    uint32_t items;
+} spo_slab_chunk_t;
+
+typedef struct
+{
+    spo_memory_t *memory;
+    void *free_items; /* singly linked list of free items */
+    spo_slab_chunk_t *chunks;
+    uint32_t item_size;
+    uint32_t item_alignment;
+    uint32_t items_per_chunk;
+    uint32_t items_allocated; /* total items in all chunks */
+    uint32_t items_used;
+} spo_slab_t;
+
+void spo_slab_init(spo_slab_t *slab, spo_memory_t *memory,
+    uint32_t item_size, uint32_t item_alignment, uint32_t items_per_chunk);
+void spo_slab_destroy(spo_slab_t *slab);
+spo_bool_t spo_slab_reserve(spo_slab_t *slab, uint32_t items);
+void *spo_slab_alloc(spo_slab_t *slab);
+void spo_slab_free(spo_slab_t *slab, void *item);
+
+#endif
@@ -25,6 +25,13 @@ THE SOFTWARE.
 
 #include "pstdint.h"
 
+typedef uint64_t spo_time_t; /* monotonic time in microseconds */
+
+#define SPO_TIME_FROM_MSECS(msecs) ((spo_time_t)(msecs) * 1000)
+#define SPO_TIME_TO_MSECS(time) ((uint32_t)((time) / 1000))
+
+spo_time_t spo_time_now();
+
 uint32_t spo_time_current();
 uint32_t spo_time_elapsed(uint32_t from_time);
 
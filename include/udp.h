@@ -25,6 +25,7 @@ THE SOFTWARE.
 
 #include "common.h"
 #include "pstdint.h"
+#include "alloc.h"
 
 #define SPO_NET_MAX_PACKET_SIZE 1280
 
@@ -51,11 +52,17 @@ spo_bool_t spo_net_equal_addresses(const spo_net_address_t *first, const spo_net
 spo_bool_t spo_net_init();
 void spo_net_shutdown();
 
-spo_net_socket_t spo_net_new_socket(const spo_net_address_t *bind_address, uint32_t buf_size);
+spo_net_socket_t spo_net_new_socket(const spo_net_address_t *bind_address, uint32_t buf_size, spo_memory_t *memory);
 spo_bool_t spo_net_data_available(spo_net_socket_t socket);
 void spo_net_close_socket(spo_net_socket_t socket);
 
 uint32_t spo_net_recv(spo_net_socket_t socket, uint8_t *buf, uint32_t buf_size, spo_net_address_t *address);
 uint32_t spo_net_send(spo_net_socket_t socket, const uint8_t *buf, uint32_t buf_size, const spo_net_address_t *address);
 
+/* socket is handed to another process over a connected unix domain stream socket with the accompanying data,
+   not supported on windows */
+spo_bool_t spo_net_send_socket(spo_net_socket_t socket, int unix_socket, const uint8_t *data, uint32_t data_size);
+/* received data are allocated with 'memory', the caller releases them */
+spo_net_socket_t spo_net_receive_socket(int unix_socket, spo_memory_t *memory, uint8_t **data, uint32_t *data_size);
+
 #endif
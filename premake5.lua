@@ -58,3 +58,54 @@ project "spillover-tests"
     filter "configurations:Release"
         defines { "NDEBUG" }
         optimize "On"
+
+project "spillover-bench-scoreboard"
+    kind "ConsoleApp"
+    language "C"
+    targetdir "bin/%{cfg.platform}/%{cfg.buildcfg}"
+    includedirs { "./include" }
+    files { "**.h", "bench/scoreboard.c" }
+    links { "spillover" }
+
+    filter "configurations:Debug"
+        defines { "_DEBUG" }
+        flags { "Symbols" }
+
+    filter "configurations:Release"
+        defines { "NDEBUG" }
+        optimize "On"
+
+project "spillover-bench-buffers"
+    kind "ConsoleApp"
+    language "C"
+    targetdir "bin/%{cfg.platform}/%{cfg.buildcfg}"
+    includedirs { "./include" }
+    files { "**.h", "bench/buffers.c" }
+    links { "spillover" }
+
+    filter "configurations:Debug"
+        defines { "_DEBUG" }
+        flags { "Symbols" }
+
+    filter "configurations:Release"
+        defines { "NDEBUG" }
+        optimize "On"
+
+project "spillover-bench-lossy"
+    kind "ConsoleApp"
+    language "C"
+    targetdir "bin/%{cfg.platform}/%{cfg.buildcfg}"
+    includedirs { "./include" }
+    files { "**.h", "bench/lossy.c" }
+    links { "spillover" }
+
+    configurations { "windows" }
+        links { "Ws2_32.lib" }
+
+    filter "configurations:Debug"
+        defines { "_DEBUG" }
+        flags { "Symbols" }
+
+    filter "configurations:Release"
+        defines { "NDEBUG" }
+        optimize "On"
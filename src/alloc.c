@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include "alloc.h"
+
+static void *spo_internal_default_alloc(void *context, size_t size)
+{
+    (void)context;
+    return malloc(size);
+}
+
+static void *spo_internal_default_realloc(void *context, void *ptr, size_t old_size, size_t new_size)
+{
+    (void)context;
+    (void)old_size;
+    return realloc(ptr, new_size);
+}
+
+static void spo_internal_default_free(void *context, void *ptr, size_t size)
+{
+    (void)context;
+    (void)size;
+    free(ptr);
+}
+
+void spo_memory_init(spo_memory_t *memory, const spo_allocator_t *allocator)
+{
+    /* the hooks work in a set, so an incomplete allocator is replaced by the default one entirely */
+    if (allocator != NULL && allocator->alloc != NULL && allocator->realloc != NULL && allocator->free != NULL)
+        memory->allocator = *allocator;
+    else
+    {
+        memory->allocator.alloc = spo_internal_default_alloc;
+        memory->allocator.realloc = spo_internal_default_realloc;
+        memory->allocator.free = spo_internal_default_free;
+        memory->allocator.context = NULL;
+    }
+
+    memory->counters.allocations = 0;
+    memory->counters.reallocations = 0;
+    memory->counters.deallocations = 0;
+    memory->counters.bytes_in_use = 0;
+}
+
+void *spo_memory_alloc(spo_memory_t *memory, size_t size)
+{
+    void *ptr = memory->allocator.alloc(memory->allocator.context, size);
+
+    if (ptr != NULL)
+    {
+        ++memory->counters.allocations;
+        memory->counters.bytes_in_use += size;
+    }
+
+    return ptr;
+}
+
+void *spo_memory_realloc(spo_memory_t *memory, void *ptr, size_t old_size, size_t new_size)
+{
+    void *new_ptr;
+
+    if (ptr == NULL)
+        return spo_memory_alloc(memory, new_size);
+
+    new_ptr = memory->allocator.realloc(memory->allocator.context, ptr, old_size, new_size);
+    if (new_ptr != NULL)
+    {
+        ++memory->counters.reallocations;
+        memory->counters.bytes_in_use += new_size;
+        memory->counters.bytes_in_use -= old_size;
+    }
+
+    return new_ptr;
+}
+
+void spo_memory_free(spo_memory_t *memory, void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return;
+
+    memory->allocator.free(memory->allocator.context, ptr, size);
+
+    ++memory->counters.deallocations;
+    memory->counters.bytes_in_use -= size;
+}
@@ -0,0 +1,462 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <string.h>
+#include "bitmap.h"
+
+#if defined(_MSC_VER) && defined(_WIN64)
+#include <intrin.h>
+#endif
+
+#define SPO_BITMAP_WORD_BITS 64
+#define SPO_BITMAP_WORD_SHIFT 6
+#define SPO_BITMAP_LEVELS 3 /* the bits and two summary levels */
+#define SPO_BITMAP_MIN_SIZE (1 << (SPO_BITMAP_WORD_SHIFT * (SPO_BITMAP_LEVELS - 1))) /* one bit at the top level */
+
+/* each bit of the level covers 64^level bits of the bitmap */
+#define SPO_BITMAP_LEVEL_SHIFT(level) (SPO_BITMAP_WORD_SHIFT * (level))
+#define SPO_BITMAP_LEVEL_BITS(bitmap, level) ((bitmap)->size >> SPO_BITMAP_LEVEL_SHIFT(level))
+#define SPO_BITMAP_LEVEL_WORDS(bitmap, level) \
+    ((SPO_BITMAP_LEVEL_BITS(bitmap, level) + SPO_BITMAP_WORD_BITS - 1) / SPO_BITMAP_WORD_BITS)
+
+/* count of trailing zeros, 'value' is never 0 */
+SPO_INLINE uint32_t spo_internal_count_trailing_zeros(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctzll(value);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (uint32_t)index;
+#else
+    uint32_t count = 0;
+
+    while ((value & 0xFF) == 0)
+    {
+        value >>= 8;
+        count += 8;
+    }
+    while ((value & 1) == 0)
+    {
+        value >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+/* count of leading zeros, 'value' is never 0 */
+SPO_INLINE uint32_t spo_internal_count_leading_zeros(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_clzll(value);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (uint32_t)(SPO_BITMAP_WORD_BITS - 1 - index);
+#else
+    uint32_t count = 0;
+
+    while ((value >> (SPO_BITMAP_WORD_BITS - 8)) == 0)
+    {
+        value <<= 8;
+        count += 8;
+    }
+    while ((value >> (SPO_BITMAP_WORD_BITS - 1)) == 0)
+    {
+        value <<= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+/* count of the set bits starting at 'bit', the shifted in zeros stop the count at the end of the word */
+SPO_INLINE uint32_t spo_internal_count_trailing_ones(uint64_t value, uint32_t bit)
+{
+    uint64_t inverted = ~(value >> bit);
+
+    return (inverted == 0) ? SPO_BITMAP_WORD_BITS : spo_internal_count_trailing_zeros(inverted);
+}
+
+/* mask of 'count' bits starting at 'bit', the bits don't cross the word boundary */
+SPO_INLINE uint64_t spo_internal_get_mask(uint32_t bit, uint32_t count)
+{
+    if (count == SPO_BITMAP_WORD_BITS)
+        return ~(uint64_t)0;
+
+    return (((uint64_t)1 << count) - 1) << bit;
+}
+
+SPO_INLINE size_t spo_internal_get_memory_size(const spo_bitmap_t *bitmap)
+{
+    uint32_t level;
+    size_t words = SPO_BITMAP_LEVEL_WORDS(bitmap, 0);
+
+    for (level = 1; level < SPO_BITMAP_LEVELS; ++level)
+        words += 2 * SPO_BITMAP_LEVEL_WORDS(bitmap, level);
+
+    return words * sizeof(uint64_t);
+}
+
+/* bits of the summary level are set for the full units and for the used ones,
+   level 0 keeps the bits themselves */
+SPO_INLINE uint64_t *spo_internal_get_level(const spo_bitmap_t *bitmap, uint32_t level, spo_bool_t full)
+{
+    uint32_t i;
+    uint64_t *words = bitmap->words;
+
+    if (level == 0)
+        return words;
+
+    words += SPO_BITMAP_LEVEL_WORDS(bitmap, 0);
+    for (i = 1; i < level; ++i)
+        words += 2 * SPO_BITMAP_LEVEL_WORDS(bitmap, i);
+
+    return full ? words : words + SPO_BITMAP_LEVEL_WORDS(bitmap, level);
+}
+
+/* the small levels don't fill their only word */
+SPO_INLINE uint64_t spo_internal_get_valid_mask(const spo_bitmap_t *bitmap, uint32_t level)
+{
+    return spo_internal_get_mask(0, SPO_MIN(SPO_BITMAP_LEVEL_BITS(bitmap, level), SPO_BITMAP_WORD_BITS));
+}
+
+/* word 'index' of the level has changed, so the levels above it are updated */
+SPO_INLINE void spo_internal_update_summaries(spo_bitmap_t *bitmap, uint32_t level, uint32_t index)
+{
+    uint64_t *full;
+    uint64_t *used;
+    uint64_t bit;
+    uint64_t full_word = spo_internal_get_level(bitmap, level, SPO_TRUE)[index];
+    uint64_t used_word = spo_internal_get_level(bitmap, level, SPO_FALSE)[index];
+    uint64_t valid_mask = spo_internal_get_valid_mask(bitmap, level);
+
+    for (++level; level < SPO_BITMAP_LEVELS; ++level)
+    {
+        full = spo_internal_get_level(bitmap, level, SPO_TRUE);
+        used = spo_internal_get_level(bitmap, level, SPO_FALSE);
+        bit = (uint64_t)1 << (index % SPO_BITMAP_WORD_BITS);
+        index /= SPO_BITMAP_WORD_BITS;
+
+        if (full_word == valid_mask)
+            full[index] |= bit;
+        else
+            full[index] &= ~bit;
+
+        if (used_word != 0)
+            used[index] |= bit;
+        else
+            used[index] &= ~bit;
+
+        full_word = full[index];
+        used_word = used[index];
+        valid_mask = spo_internal_get_valid_mask(bitmap, level);
+    }
+}
+
+SPO_INLINE void spo_internal_change_bits(spo_bitmap_t *bitmap, uint32_t position, uint32_t count, spo_bool_t set)
+{
+    uint32_t bit;
+    uint32_t bits;
+    uint32_t index;
+    uint32_t words;
+    uint64_t mask;
+    uint64_t *full = spo_internal_get_level(bitmap, 1, SPO_TRUE);
+    uint64_t *used = spo_internal_get_level(bitmap, 1, SPO_FALSE);
+
+    while (count > 0)
+    {
+        position &= bitmap->size - 1;
+        index = position / SPO_BITMAP_WORD_BITS;
+        bit = position % SPO_BITMAP_WORD_BITS;
+
+        if (bit == 0 && count >= SPO_BITMAP_WORD_BITS)
+        {
+            /* whole words are changed up to the end of their summary word */
+            words = SPO_MIN(count / SPO_BITMAP_WORD_BITS, SPO_BITMAP_WORD_BITS - index % SPO_BITMAP_WORD_BITS);
+            mask = spo_internal_get_mask(index % SPO_BITMAP_WORD_BITS, words);
+
+            memset(bitmap->words + index, set ? 0xFF : 0, words * sizeof(uint64_t));
+
+            if (set)
+            {
+                full[index / SPO_BITMAP_WORD_BITS] |= mask;
+                used[index / SPO_BITMAP_WORD_BITS] |= mask;
+            }
+            else
+            {
+                full[index / SPO_BITMAP_WORD_BITS] &= ~mask;
+                used[index / SPO_BITMAP_WORD_BITS] &= ~mask;
+            }
+
+            spo_internal_update_summaries(bitmap, 1, index / SPO_BITMAP_WORD_BITS);
+
+            position += words * SPO_BITMAP_WORD_BITS;
+            count -= words * SPO_BITMAP_WORD_BITS;
+            continue;
+        }
+
+        bits = SPO_MIN(SPO_BITMAP_WORD_BITS - bit, count);
+        mask = spo_internal_get_mask(bit, bits);
+
+        if (set)
+            bitmap->words[index] |= mask;
+        else
+            bitmap->words[index] &= ~mask;
+
+        spo_internal_update_summaries(bitmap, 0, index);
+
+        position += bits;
+        count -= bits;
+    }
+}
+
+/* count of the consecutive bits equal to 'value' from 'position', no more than 'limit' */
+SPO_INLINE uint32_t spo_internal_count_run(const spo_bitmap_t *bitmap, uint32_t position, uint32_t limit, spo_bool_t value)
+{
+    uint32_t level;
+    uint32_t index;
+    uint32_t run;
+    uint64_t word;
+    uint32_t count = 0;
+
+    while (count < limit)
+    {
+        position &= bitmap->size - 1;
+
+        /* start from the highest level which has a unit starting at the position */
+        level = SPO_BITMAP_LEVELS - 1;
+        while (level > 0 && (position & ((1 << SPO_BITMAP_LEVEL_SHIFT(level)) - 1)) != 0)
+            --level;
+
+        for (;; --level)
+        {
+            index = position >> SPO_BITMAP_LEVEL_SHIFT(level);
+            word = spo_internal_get_level(bitmap, level, value)[index / SPO_BITMAP_WORD_BITS];
+            if (!value)
+                word = ~word; /* set bits mark the clear units */
+
+            run = spo_internal_count_trailing_ones(word, index % SPO_BITMAP_WORD_BITS);
+            run = SPO_MIN(run, SPO_BITMAP_LEVEL_BITS(bitmap, level) - index);
+
+            if (run > 0 || level == 0)
+                break;
+        }
+
+        count += run << SPO_BITMAP_LEVEL_SHIFT(level);
+        position += run << SPO_BITMAP_LEVEL_SHIFT(level);
+
+        /* the run is over if it ends within the word of bits */
+        if (level == 0 && index % SPO_BITMAP_WORD_BITS + run < SPO_BITMAP_WORD_BITS)
+            break;
+    }
+
+    return SPO_MIN(count, limit);
+}
+
+/* count of the set bits ending at 'bit' and going down, the shifted in zeros stop the count at the start of the word */
+SPO_INLINE uint32_t spo_internal_count_leading_ones(uint64_t value, uint32_t bit)
+{
+    uint64_t inverted = ~(value << (SPO_BITMAP_WORD_BITS - 1 - bit));
+
+    return (inverted == 0) ? SPO_BITMAP_WORD_BITS : spo_internal_count_leading_zeros(inverted);
+}
+
+/* count of the consecutive set bits before 'position' going backward, no more than 'limit' */
+SPO_INLINE uint32_t spo_internal_count_run_backward(const spo_bitmap_t *bitmap, uint32_t position, uint32_t limit)
+{
+    uint32_t level;
+    uint32_t index;
+    uint32_t run;
+    uint64_t word;
+    uint32_t count = 0;
+
+    while (count < limit)
+    {
+        position &= bitmap->size - 1;
+
+        /* start from the highest level which has a unit ending at the position */
+        level = SPO_BITMAP_LEVELS - 1;
+        while (level > 0 && (position & ((1 << SPO_BITMAP_LEVEL_SHIFT(level)) - 1)) != 0)
+            --level;
+
+        for (;; --level)
+        {
+            index = ((position - 1) & (bitmap->size - 1)) >> SPO_BITMAP_LEVEL_SHIFT(level);
+            word = spo_internal_get_level(bitmap, level, SPO_TRUE)[index / SPO_BITMAP_WORD_BITS];
+
+            run = spo_internal_count_leading_ones(word, index % SPO_BITMAP_WORD_BITS);
+            if (run > 0 || level == 0)
+                break;
+        }
+
+        count += run << SPO_BITMAP_LEVEL_SHIFT(level);
+        position -= run << SPO_BITMAP_LEVEL_SHIFT(level);
+
+        /* the run is over if it starts within the word of bits */
+        if (level == 0 && run <= index % SPO_BITMAP_WORD_BITS)
+            break;
+    }
+
+    return SPO_MIN(count, limit);
+}
+
+void spo_bitmap_init(spo_bitmap_t *bitmap, spo_memory_t *memory, uint32_t window_size)
+{
+    uint32_t size = SPO_BITMAP_MIN_SIZE;
+
+    /* the power of two size lets the positions wrap with a mask */
+    while (size < window_size)
+        size *= 2;
+
+    bitmap->words = NULL;
+    bitmap->size = size;
+    bitmap->head = 0;
+    bitmap->prefix = 0;
+    bitmap->length = 0;
+    bitmap->window_size = window_size;
+    bitmap->memory = memory;
+}
+
+void spo_bitmap_destroy(spo_bitmap_t *bitmap)
+{
+    if (bitmap->words != NULL)
+        spo_memory_free(bitmap->memory, bitmap->words, spo_internal_get_memory_size(bitmap));
+
+    bitmap->words = NULL;
+    bitmap->head = 0;
+    bitmap->prefix = 0;
+    bitmap->length = 0;
+}
+
+spo_bool_t spo_bitmap_set_range(spo_bitmap_t *bitmap, uint32_t offset, uint32_t count)
+{
+    uint32_t end;
+    uint32_t old_prefix;
+
+    if (offset > bitmap->window_size || count > bitmap->window_size - offset)
+        return SPO_FALSE;
+
+    end = offset + count;
+
+    if (offset <= bitmap->prefix)
+    {
+        /* in-order bits only move the counter, so the ring isn't touched until there is a hole */
+        if (end <= bitmap->prefix)
+            return SPO_TRUE;
+
+        old_prefix = bitmap->prefix;
+        bitmap->prefix = end;
+
+        if (bitmap->length > old_prefix)
+        {
+            /* the stored bits become a part of the prefix, so clear them for the next turn of the ring */
+            spo_internal_change_bits(bitmap, bitmap->head + old_prefix,
+                SPO_MIN(end, bitmap->length) - old_prefix, SPO_FALSE);
+
+            if (bitmap->length > end)
+            {
+                count = spo_internal_count_run(bitmap, bitmap->head + end, bitmap->length - end, SPO_TRUE);
+                spo_internal_change_bits(bitmap, bitmap->head + end, count, SPO_FALSE);
+                bitmap->prefix += count;
+            }
+        }
+
+        if (bitmap->length < bitmap->prefix)
+            bitmap->length = bitmap->prefix;
+
+        return SPO_TRUE;
+    }
+
+    if (bitmap->words == NULL)
+    {
+        bitmap->words = (uint64_t *)spo_memory_alloc(bitmap->memory, spo_internal_get_memory_size(bitmap));
+        if (bitmap->words == NULL)
+            return SPO_FALSE;
+
+        memset(bitmap->words, 0, spo_internal_get_memory_size(bitmap));
+    }
+
+    spo_internal_change_bits(bitmap, bitmap->head + offset, count, SPO_TRUE);
+
+    if (bitmap->length < end)
+        bitmap->length = end;
+
+    return SPO_TRUE;
+}
+
+uint32_t spo_bitmap_consume_prefix(spo_bitmap_t *bitmap)
+{
+    uint32_t count = bitmap->prefix;
+
+    bitmap->head = (bitmap->head + count) & (bitmap->size - 1);
+    bitmap->length -= count;
+    bitmap->prefix = 0;
+    return count;
+}
+
+spo_bool_t spo_bitmap_find_run(const spo_bitmap_t *bitmap, uint32_t *offset, uint32_t *count)
+{
+    uint32_t start = *offset;
+
+    /* the prefix is always followed by a clear bit */
+    if (start < bitmap->prefix)
+    {
+        *count = bitmap->prefix - start;
+        return SPO_TRUE;
+    }
+
+    if (start >= bitmap->length)
+        return SPO_FALSE;
+
+    start += spo_internal_count_run(bitmap, bitmap->head + start, bitmap->length - start, SPO_FALSE);
+    if (start >= bitmap->length)
+        return SPO_FALSE;
+
+    *offset = start;
+    *count = spo_internal_count_run(bitmap, bitmap->head + start, bitmap->length - start, SPO_TRUE);
+    return SPO_TRUE;
+}
+
+spo_bool_t spo_bitmap_get_run(const spo_bitmap_t *bitmap, uint32_t *offset, uint32_t *count)
+{
+    uint32_t start = *offset;
+
+    if (start < bitmap->prefix)
+    {
+        *offset = 0;
+        *count = bitmap->prefix;
+        return SPO_TRUE;
+    }
+
+    if (start >= bitmap->length || spo_internal_count_run(bitmap, bitmap->head + start, 1, SPO_TRUE) == 0)
+        return SPO_FALSE;
+
+    /* the stored bits never continue the prefix */
+    start -= spo_internal_count_run_backward(bitmap, bitmap->head + start, start - bitmap->prefix);
+
+    *offset = start;
+    *count = spo_internal_count_run(bitmap, bitmap->head + start, bitmap->length - start, SPO_TRUE);
+    return SPO_TRUE;
+}
@@ -20,33 +20,45 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
-#include <stdlib.h>
 #include <string.h>
 #include "index.h"
 
-#define SPO_INDEX_ALLOCATION_INCREMENT 10
 
 /* unsigned arithmetic does all the magic */
 #define SPO_WRAPPED_LESS(a, b) ((int32_t)((a)-(b)) < 0)
 
-void spo_index_init(spo_index_t *index)
+#define SPO_INDEX_STORAGE(index) ((index)->items - (index)->offset)
+
+void spo_index_init(spo_index_t *index, spo_memory_t *memory)
 {
     index->items = NULL;
     index->length = 0;
     index->size = 0;
+    index->offset = 0;
+    index->memory = memory;
 }
 
 void spo_index_destroy(spo_index_t *index)
 {
-    if (index->items != NULL)
-        free(index->items);
+    if (index->items != NULL && SPO_INDEX_STORAGE(index) != index->inline_items)
+        spo_memory_free(index->memory, SPO_INDEX_STORAGE(index), index->size * sizeof(spo_index_item_t));
 
     index->items = NULL;
     index->length = 0;
     index->size = 0;
+    index->offset = 0;
 }
 
-spo_index_item_t *spo_index_find_pos_by_key(spo_index_t *index, uint32_t key)
+void spo_index_clear(spo_index_t *index)
+{
+    if (index->items != NULL)
+        index->items = SPO_INDEX_STORAGE(index);
+
+    index->length = 0;
+    index->offset = 0;
+}
+
+spo_index_item_t *spo_index_find_pos_by_key(spo_index_t *index, uint32_t start)
 {
     spo_index_item_t *item;
     int middle;
@@ -58,10 +70,10 @@ spo_index_item_t *spo_index_find_pos_by_key(spo_index_t *index, uint32_t key)
         middle = (low + high) / 2;
         item = index->items + middle;
 
-        if (item->key == key)
+        if (item->start == start)
             return item;
 
-        if (SPO_WRAPPED_LESS(key, item->key))
+        if (SPO_WRAPPED_LESS(start, item->start))
             high = middle - 1;
         else
             low = middle + 1;
@@ -73,38 +85,69 @@ spo_index_item_t *spo_index_find_pos_by_key(spo_index_t *index, uint32_t key)
     return NULL;
 }
 
-spo_index_item_t *spo_index_insert_item_after(spo_index_t *index, spo_index_item_t *after_item, uint32_t key, void *data)
+/* makes room for one more item at the end of the array */
+SPO_INLINE spo_bool_t spo_internal_make_room(spo_index_t *index)
 {
-    spo_index_item_t *new_item;
+    spo_index_item_t *storage = SPO_INDEX_STORAGE(index);
+    spo_index_item_t *new_items;
+    uint32_t new_size = index->size * 2;
 
-    if (index->size == index->length)
+    if (index->offset >= index->length)
     {
-        uint32_t new_size = index->size + SPO_INDEX_ALLOCATION_INCREMENT;
-        spo_index_item_t *new_items = (spo_index_item_t *)realloc(index->items, new_size * sizeof(spo_index_item_t));
+        /* at least a half of the array is free, so the items are moved to its start */
+        memmove(storage, index->items, index->length * sizeof(spo_index_item_t));
+        index->items = storage;
+        index->offset = 0;
+        return SPO_TRUE;
+    }
 
+    /* geometric growth keeps the reallocations rare for the long lists of holes */
+    if (storage == index->inline_items)
+    {
+        /* inline items move to the heap */
+        new_items = (spo_index_item_t *)spo_memory_alloc(index->memory, new_size * sizeof(spo_index_item_t));
         if (new_items == NULL)
-            return NULL;
-
-        if (after_item == NULL)
-            new_item = new_items; /* insert as head */
-        else
-            new_item = new_items + (after_item - index->items) + 1; /* insert regular item */
+            return SPO_FALSE;
 
-        index->items = new_items;
-        index->size = new_size;
+        memcpy(new_items, index->items, index->length * sizeof(spo_index_item_t));
+        index->offset = 0;
     }
     else
     {
-        if (after_item == NULL)
-            new_item = index->items; /* insert as head */
-        else
-            new_item = after_item + 1; /* insert regular item */
+        new_items = (spo_index_item_t *)spo_memory_realloc(index->memory, storage,
+            index->size * sizeof(spo_index_item_t), new_size * sizeof(spo_index_item_t));
+        if (new_items == NULL)
+            return SPO_FALSE;
     }
 
-    memmove(new_item + 1, new_item, (index->length - (new_item - index->items)) * sizeof(spo_index_item_t));
+    index->items = new_items + index->offset;
+    index->size = new_size;
+    return SPO_TRUE;
+}
+
+spo_index_item_t *spo_index_insert_item_after(spo_index_t *index, spo_index_item_t *after_item, uint32_t start, uint32_t size)
+{
+    spo_index_item_t *new_item;
+    uint32_t position = (after_item == NULL) ? 0 : (uint32_t)(after_item - index->items) + 1;
 
-    new_item->key = key;
-    new_item->data = data;
+    if (index->items == NULL)
+    {
+        index->items = index->inline_items;
+        index->size = SPO_INDEX_INLINE_SIZE;
+        index->offset = 0;
+    }
+
+    if (index->offset + index->length == index->size)
+    {
+        if (!spo_internal_make_room(index))
+            return NULL;
+    }
+
+    new_item = index->items + position;
+    memmove(new_item + 1, new_item, (index->length - position) * sizeof(spo_index_item_t));
+
+    new_item->start = start;
+    new_item->size = size;
 
     ++index->length;
     return new_item;
@@ -114,8 +157,108 @@ spo_index_item_t *spo_index_remove_item(spo_index_t *index, spo_index_item_t *it
 {
     spo_index_item_t *next_item = item + 1;
 
+    if (item == index->items)
+    {
+        /* the head is removed without moving the rest */
+        --index->length;
+        if (index->length == 0)
+        {
+            spo_index_clear(index);
+            return index->items;
+        }
+
+        index->items = next_item;
+        ++index->offset;
+        return next_item;
+    }
+
     memmove(item, next_item, (index->length - (next_item - index->items)) * sizeof(spo_index_item_t));
 
     --index->length;
     return item;
 }
+
+/* intervals are stored in the index items, so the merge doesn't allocate anything
+   unless the index has to grow */
+spo_bool_t spo_index_merge_item(spo_index_t *index, uint32_t start, uint32_t size)
+{
+    uint32_t current_start;
+    uint32_t current_end;
+    uint32_t prev_end;
+    spo_index_item_t *prev_item;
+    spo_index_item_t *current;
+
+    /* search item after which a new item can be inserted */
+    current = spo_index_find_pos_by_key(index, start);
+    if (current == NULL)
+    {
+        /* insert head */
+        current = spo_index_insert_item_after(index, NULL, start, size);
+        if (current == NULL)
+            return SPO_FALSE;
+
+        prev_item = current;
+        /* get the next item */
+        current = SPO_INDEX_NEXT(index, current);
+    }
+    else
+    {
+        prev_item = current;
+
+        /* new interval is a current item */
+        current_start = start;
+        current_end = current_start + size;
+        prev_end = prev_item->start + prev_item->size;
+
+        /* don't check for current_start >= prev_start as it's always true */
+        if (SPO_WRAPPED_LESS(prev_end, current_end))
+        {
+            if (SPO_WRAPPED_LESS(prev_end, current_start))
+            {
+                current = spo_index_insert_item_after(index, current, start, size);
+                if (current == NULL)
+                    return SPO_FALSE;
+                /* set new item as a previous item */
+                prev_item = current;
+            }
+            else
+            {
+                /* new interval starts within previous and ends after the previous */
+                prev_item->size += (current_end - prev_end);
+            }
+            /* get the next item */
+            current = SPO_INDEX_NEXT(index, current);
+        }
+        else
+        {
+            /* previous item includes the current one */
+            /* merge is completed because nothing has changed */
+            return SPO_TRUE;
+        }
+    }
+
+    /* items are sorted by start seq */
+    while (SPO_INDEX_VALID(index, current))
+    {
+        current_start = current->start;
+        current_end = current_start + current->size;
+        prev_end = prev_item->start + prev_item->size;
+
+        /* don't check for current_start >= prev_start as it's always true */
+        if (SPO_WRAPPED_LESS(prev_end, current_end))
+        {
+            if (SPO_WRAPPED_LESS(prev_end, current_start))
+            {
+                /* a hole in the data, merge is completed */
+                break;
+            }
+            /* current item starts within previous and ends after the previous */
+            prev_item->size += (current_end - prev_end);
+        }
+        /* else previous item includes the current one */
+
+        current = spo_index_remove_item(index, current);
+    }
+
+    return SPO_TRUE;
+}
@@ -20,14 +20,14 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
-#include <stdlib.h>
 #include "list.h"
 
-void spo_list_init(spo_list_t *list)
+void spo_list_init(spo_list_t *list, spo_slab_t *slab)
 {
     list->head = NULL;
     list->tail = NULL;
     list->length = 0;
+    list->slab = slab;
 }
 
 void spo_list_destroy(spo_list_t *list)
@@ -38,7 +38,7 @@ void spo_list_destroy(spo_list_t *list)
     while (current != NULL)
     {
         next = current->next_item;
-        free(current);
+        spo_slab_free(list->slab, current);
         current = next;
     }
 
@@ -50,7 +50,7 @@ void spo_list_destroy(spo_list_t *list)
 spo_list_item_t *spo_list_add_item(spo_list_t *list, void *data)
 {
     spo_list_item_t *current = list->tail;
-    spo_list_item_t *new_item = (spo_list_item_t *)malloc(sizeof(spo_list_item_t));
+    spo_list_item_t *new_item = (spo_list_item_t *)spo_slab_alloc(list->slab);
 
     if (new_item == NULL)
         return NULL;
@@ -100,7 +100,7 @@ spo_list_item_t *spo_list_remove_item(spo_list_t *list, spo_list_item_t *item)
         list->head = next;
     }
 
-    free(item);
+    spo_slab_free(list->slab, item);
 
     --list->length;
     return next;
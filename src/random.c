@@ -24,6 +24,7 @@ THE SOFTWARE.
 #include <windows.h>
 #else
 #include <time.h>
+#include <stdio.h>
 #endif
 
 #include "random.h"
@@ -94,3 +95,23 @@ uint32_t spo_random_next()
 
     return spo_rand_z;
 }
+
+void spo_random_fill(uint8_t *buf, uint32_t size)
+{
+    uint32_t i;
+
+#ifndef _WIN32
+    FILE *source = fopen("/dev/urandom", "rb");
+    if (source != NULL)
+    {
+        size_t bytes_read = fread(buf, 1, size, source);
+        fclose(source);
+
+        if (bytes_read == size)
+            return;
+    }
+#endif
+
+    for (i = 0; i < size; ++i)
+        buf[i] = (uint8_t)(spo_random_next() >> 24);
+}
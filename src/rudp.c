@@ -28,27 +28,62 @@ THE SOFTWARE.
 #include "rudp.h"
 #include "list.h"
 #include "index.h"
+#include "bitmap.h"
 #include "packet.h"
 #include "time.h"
 #include "random.h"
+#include "slab.h"
+#include "segment.h"
+#include "siphash.h"
+#include "alloc.h"
 
 #define SPO_HEADER_SIZE(acks_count) (sizeof(spo_packet_header_t) + (acks_count) * sizeof(spo_packet_header_sack_t))
 #define SPO_MAX_PAYLOAD_SIZE (SPO_NET_MAX_PACKET_SIZE - sizeof(spo_packet_header_t))
 
-#define SPO_MIN(x, y) ((x) < (y) ? (x) : (y))
-#define SPO_MAX(x, y) ((x) > (y) ? (x) : (y))
-
 /* unsigned arithmetic does all the magic */
 #define SPO_WRAPPED_LESS(a, b)       ((int32_t)((a)-(b)) < 0)
 #define SPO_WRAPPED_LESS_EQ(a, b)    ((int32_t)((a)-(b)) <= 0)
 #define SPO_WRAPPED_GREATER(a, b)    ((int32_t)((a)-(b)) > 0)
 #define SPO_WRAPPED_GREATER_EQ(a, b) ((int32_t)((a)-(b)) >= 0)
 
+#define SPO_SLAB_CHUNK_ITEMS 64
+#define SPO_NO_TIMER_SLOT UINT32_MAX
+
+/* cookie is valid within the current and the previous interval */
+#define SPO_COOKIE_INTERVAL 8000 /* msecs */
+#define SPO_COOKIE_PORT_ATTEMPTS 16
+
+/* source addresses are tracked by the fixed-size table, so spoofed sources can't exhaust the memory */
+#define SPO_SOURCE_LIMITS_SIZE 1024
+#define SPO_TOKEN_SIZE SPO_TIME_FROM_MSECS(1000) /* token buckets refill with microsecond precision */
+
+/* receive and transmit work are interleaved, so a flood of incoming packets can't starve the connections */
+#define SPO_RECEIVE_BATCH 64
+#define SPO_PROGRESS_MAX_PACKETS 1024 /* packets received by spo_make_progress(), default packets budget */
+
+/* outgoing handshakes */
+#define SPO_CONNECT_PACING_DELAY SPO_TIME_FROM_MSECS(1) /* pacer catches up no more than this, so the bursts stay short */
+#define SPO_MAX_CONNECT_BACKOFF_SHIFT 4 /* retransmission timeout grows up to 16 times */
+
+/* new address of the other side is challenged no more often than this */
+#define SPO_MIGRATION_CHALLENGE_INTERVAL 250 /* msecs */
+
+/* state of the live upgrade */
+#define SPO_STATE_MAGIC 0x53504F53 /* "SPOS" */
+#define SPO_STATE_VERSION 1
+
+/* hibernating connection keeps no arrays, each one is allocated again on demand */
+#define SPO_CONNECTION_HIBERNATING(connection) ((connection)->rcv_buf.segments == NULL && \
+    (connection)->snd_buf.segments == NULL && (connection)->rcv_packets.items == NULL && \
+    (connection)->rcv_bitmap.words == NULL && (connection)->snd_acked_packets.items == NULL && \
+    (connection)->snd_lost_ranges.items == NULL)
+
 #define SPO_WRAPPED_MIN(a, b) (SPO_WRAPPED_LESS((a), (b)) ? (a) : (b))
 #define SPO_WRAPPED_MAX(a, b) (SPO_WRAPPED_GREATER((a), (b)) ? (a) : (b))
 
 typedef struct spo_host_data spo_host_data_t;
 typedef struct spo_connection_data spo_connection_data_t;
+typedef struct spo_pool_data spo_pool_data_t;
 
 typedef enum
 {
@@ -57,58 +92,195 @@ typedef enum
     SPO_RECOVERY_BY_TIMEOUT
 } spo_recovery_mode_t;
 
+/* bucket holds up to one second worth of tokens */
+typedef struct
+{
+    uint64_t tokens; /* in 1/SPO_TOKEN_SIZE units */
+    spo_time_t update_time;
+} spo_token_bucket_t;
+
+typedef struct
+{
+    uint64_t source; /* hash of the source address, zero for unused items */
+    spo_token_bucket_t resets;
+    spo_token_bucket_t connects;
+} spo_source_limits_t;
+
+/* user buffer sent without copying, its range of the send buffer has no segments */
+typedef struct spo_send_buffer
+{
+    struct spo_send_buffer *next_buffer;
+    const uint8_t *data;
+    uint32_t start_seq;
+    uint32_t size;
+    spo_send_completion_t completion;
+    void *context;
+} spo_send_buffer_t;
+
+/* user buffer posted for the incoming data, its range of the receive buffer has no segments */
+typedef struct spo_receive_buffer
+{
+    struct spo_receive_buffer *next_buffer;
+    uint8_t *data;
+    uint32_t start_seq;
+    uint32_t size;
+    spo_receive_completion_t completion;
+    void *context;
+} spo_receive_buffer_t;
+
+/* timer deadlines of the connections, stored as a structure of arrays,
+   so the scan for expired timers streams through the deadlines only */
+typedef struct
+{
+    spo_time_t *deadlines; /* zero means that the connection has work to do right now */
+    spo_connection_data_t **connections;
+    uint32_t count;
+    uint32_t size; /* allocated size */
+    uint32_t next_slot; /* the scan stopped by the budget continues from here */
+} spo_timers_t;
+
+/* idle connections to the same address, established in advance */
+struct spo_pool_data
+{
+    spo_host_data_t *host;
+    spo_net_address_t address;
+    uint32_t size; /* connections kept idle */
+    spo_list_t connections; /* idle connections, established or being established */
+    spo_list_item_t *list_item; /* item of the 'pools' list */
+};
+
 struct spo_host_data
 {
+    spo_memory_t memory; /* allocator and allocation counters of the host */
     spo_net_socket_t socket;
     spo_configuration configuration;
     spo_callbacks_t callbacks;
     spo_list_t connections;
     spo_list_t started_connections; /* connections in SPO_CONNECTION_STATE_CONNECT_STARTED state */
     spo_list_t incoming_connections; /* connections in SPO_CONNECTION_STATE_CONNECT_RECEIVED state */
+    spo_list_t pools;
     spo_connection_data_t *connections_by_ports[UINT16_MAX];
+    spo_time_t time; /* cached time, sampled once per progress step */
+    spo_timers_t timers;
+    uint32_t packets_sent; /* wrapping counter, the progress budget is charged by its difference */
+
+    /* pools of the fixed-size objects */
+    spo_slab_t connections_slab;
+    spo_slab_t list_items_slab;
+    spo_slab_t send_buffers_slab;
+    spo_slab_t receive_buffers_slab;
+    spo_segment_pool_t segments_pool; /* memory of the connection buffers */
+
+    uint8_t secret_key[SPO_SIPHASH_KEY_SIZE]; /* key of the cookies and the source addresses hashes */
+
+    /* stateless handshake */
+    spo_time_t cookie_sent_time; /* last time a cookie was sent */
+
+    spo_bool_t exported; /* the exported connections continue in another process, they aren't reset on close */
+
+    /* overload protection */
+    spo_token_bucket_t resets_limit;
+    spo_time_t connect_pacer_time; /* next outgoing CONNECT can't be sent earlier */
+    uint32_t connects_in_flight; /* started connections which have sent CONNECT */
+    spo_source_limits_t *source_limits; /* NULL if there are no limits per source */
+
+    spo_host_statistics_t statistics; /* protocol counters, allocator counters are kept in 'memory' */
 };
 
-struct spo_connection_data
+/* configuration values used by the data path, copied into the connection
+   to avoid a dependent load through the host on every decision */
+typedef struct
 {
-    spo_host_data_t *host;
-    spo_connection_state_t state;
-    spo_net_address_t remote_address;
-    uint32_t created_time;
-    uint16_t local_port;
-    uint16_t remote_port;
+    uint32_t buf_size;
+    uint32_t initial_cwnd_bytes;
+    uint32_t cwnd_on_timeout_bytes;
+    uint32_t min_ssthresh_bytes;
+    uint32_t max_cwnd_inc_on_slowstart_bytes;
+    uint32_t duplicate_acks_for_retransmit;
+    uint32_t ssthresh_factor_on_timeout_percent;
+    uint32_t ssthresh_factor_on_loss_percent;
+    uint32_t skip_packets_before_acknowledgement;
+    uint32_t max_consecutive_acknowledges;
+    uint32_t data_retransmission_timeout;
+    uint32_t connection_timeout;
+    uint32_t ping_interval;
+    uint32_t hibernation_timeout;
+    uint32_t receive_bitmap;
+} spo_connection_parameters_t;
+
+/* data used only during the connection setup and teardown */
+typedef struct
+{
+    spo_time_t created_time;
+    spo_time_t connect_time; /* next CONNECT is due at this time */
+    spo_list_item_t *list_item; /* item of the 'connections' list */
+    spo_pool_data_t *pool; /* not NULL while the connection is idle in the pool, the user code doesn't know about it */
     uint8_t connect_attempts;
 
-    /* receiver data */
-    uint8_t *rcv_buf;
-    spo_index_t rcv_packets; /* received packets descriptors */
-    uint32_t rcv_bytes_ready; /* bytes ready to be read */
-    uint32_t rcv_start_seq; /* start of the receive buffer */
-    uint32_t rcv_last_packet_time; /* last received packet time */
+    /* migration of the other side */
+    spo_net_address_t migration_address; /* address being validated */
+    spo_time_t migration_time; /* last time the address was challenged */
+    uint32_t migration_nonce;
+    uint8_t migration_pending;
+} spo_connection_cold_data_t;
 
+/* hot data go first and are laid out in the order of the ACK and send paths */
+struct SPO_CACHE_ALIGNED spo_connection_data
+{
     /* sender data */
-    uint8_t *snd_buf;
-    uint32_t snd_buf_size; /* size of the allocated buffer */
-    spo_index_t snd_acked_packets; /* packets acked by the receiver */
-    uint32_t snd_buf_bytes; /* total bytes in the send buffer */
     uint32_t snd_start_seq; /* start of the send buffer */
     uint32_t snd_next_seq; /* first seq for the new data to send */
-    uint32_t snd_last_packet_time; /* last sent packet time */
-    uint8_t snd_mandatory_packets; /* count of mandatory packets */
+    uint32_t snd_buf_bytes; /* total bytes in the send buffer */
 
     /* variables for the congestion control algorithm */
 
-    uint8_t snd_duplicate_acks; /* duplicate acks counter */
-    uint8_t snd_mandatory_packets_skipped; /* skipped packets */
-    uint8_t snd_recovery_mode; /* indicates that sender is in recovery mode */
     uint32_t snd_cwnd_bytes; /* size of the congestion window */
     uint32_t snd_ssthresh_bytes; /* slow start threshold */
-    uint32_t snd_last_data_sent_time; /* last data transmission time */
     uint32_t snd_retransmit_next_seq; /* next seq to retransmit */
     uint32_t snd_recovery_point_seq; /* recovery mode is up to specified seq */
     uint32_t snd_retransmit_rescue_seq; /* seq for the rescue retransmission */
+    spo_time_t snd_last_data_sent_time; /* last data transmission time */
+    uint8_t snd_duplicate_acks; /* duplicate acks counter */
+    uint8_t snd_recovery_mode; /* indicates that sender is in recovery mode */
+    uint8_t snd_mandatory_packets; /* count of mandatory packets */
+    uint8_t snd_mandatory_packets_skipped; /* skipped packets */
+    uint16_t local_port;
+    uint16_t remote_port;
+    spo_segment_chain_t snd_buf; /* starts at 'snd_start_seq' */
+    spo_connection_state_t state;
+    spo_index_t snd_acked_packets; /* packets acked by the receiver */
+    spo_index_t snd_lost_ranges; /* holes before the last SACK which aren't retransmitted yet, kept in recovery mode */
+    spo_bool_t snd_lost_ranges_valid; /* SPO_FALSE if the ranges couldn't be allocated, the acks list is searched then */
+    spo_send_buffer_t *snd_user_buffers; /* buffers of spo_send_zc() ordered by seq, released once acknowledged */
+    spo_send_buffer_t *snd_last_user_buffer;
+    spo_time_t snd_last_packet_time; /* last sent packet time */
+
+    /* receiver data */
+    uint32_t rcv_start_seq; /* start of the receive buffer */
+    uint32_t rcv_bytes_ready; /* bytes ready to be read */
+    spo_time_t rcv_last_packet_time; /* last received packet time */
+    spo_time_t rcv_last_data_time; /* last time new data were received */
+    spo_segment_chain_t rcv_buf; /* segment ring from 'rcv_start_seq', ready data are followed by out-of-order data */
+    spo_index_t rcv_packets; /* received packets descriptors */
+    spo_bitmap_t rcv_bitmap; /* used instead of 'rcv_packets' if the receive bitmap is enabled */
+    spo_receive_buffer_t *rcv_posted_buffers; /* buffers of spo_post_receive() ordered by seq, released once filled */
+    spo_receive_buffer_t *rcv_last_posted_buffer;
+    uint32_t rcv_last_data_seq; /* start of the most recently received data, their range is the first SACK */
+    uint32_t rcv_sack_next_seq; /* the other SACKs rotate over the ranges starting from this seq */
+    uint8_t rcv_sacks_valid; /* 'rcv_sacks' are rebuilt after the receive scoreboard changes */
+    uint8_t rcv_sacks_count;
+    spo_packet_header_sack_t rcv_sacks[SPO_PACKET_MAX_SACKS]; /* in the wire format, copied into each packet */
+
+    spo_net_address_t remote_address; /* checked for each received packet and used for each sent one */
+    spo_host_data_t *host;
+    uint32_t timer_slot; /* position in the host timers */
+    spo_connection_parameters_t parameters;
+
+    spo_connection_cold_data_t cold;
 };
 
 static logger_ptr_t spo_logger;
+static spo_allocator_t spo_allocator; /* zeroed allocator means the default one */
 static spo_bool_t spo_allowed_packets[SPO_CONNECTION_STATES_COUNT][SPO_PACKET_TYPES_COUNT];
 
 SPO_INLINE uint32_t spo_internal_send_next_connection_data(spo_connection_data_t *connection, uint32_t cwnd_bytes);
@@ -160,14 +332,30 @@ SPO_INLINE void spo_internal_log(const char *fmt, ...)
 
 #endif
 
+/* time */
+
+SPO_INLINE void spo_internal_update_time(spo_host_data_t *host)
+{
+    spo_time_t time = spo_time_now();
+
+    /* cached time never goes backwards, so time differences are always valid */
+    if (time > host->time)
+        host->time = time;
+}
+
+SPO_INLINE spo_bool_t spo_internal_time_elapsed(spo_host_data_t *host, spo_time_t from_time, uint32_t msecs)
+{
+    return (host->time - from_time) >= SPO_TIME_FROM_MSECS(msecs);
+}
+
 /* congestion control */
 
 SPO_INLINE void spo_internal_increase_cwnd_by_bytes(spo_connection_data_t *connection, uint32_t bytes)
 {
     connection->snd_cwnd_bytes += bytes;
 
-    if (connection->snd_cwnd_bytes > connection->host->configuration.connection_buf_size)
-        connection->snd_cwnd_bytes = connection->host->configuration.connection_buf_size;
+    if (connection->snd_cwnd_bytes > connection->parameters.buf_size)
+        connection->snd_cwnd_bytes = connection->parameters.buf_size;
 }
 
 SPO_INLINE void spo_internal_decrease_cwnd_by_bytes(spo_connection_data_t *connection, uint32_t bytes)
@@ -180,9 +368,9 @@ SPO_INLINE void spo_internal_decrease_cwnd_by_bytes(spo_connection_data_t *conne
 
 SPO_INLINE void spo_internal_handle_connection_init(spo_connection_data_t *connection)
 {
-    connection->snd_last_data_sent_time = spo_time_current();
-    connection->snd_cwnd_bytes = SPO_MAX_PAYLOAD_SIZE * connection->host->configuration.initial_cwnd_in_packets;
-    connection->snd_ssthresh_bytes = connection->host->configuration.connection_buf_size;
+    connection->snd_last_data_sent_time = connection->host->time;
+    connection->snd_cwnd_bytes = connection->parameters.initial_cwnd_bytes;
+    connection->snd_ssthresh_bytes = connection->parameters.buf_size;
     connection->snd_recovery_point_seq = connection->snd_start_seq;
     connection->snd_retransmit_rescue_seq = connection->snd_start_seq;
     connection->snd_retransmit_next_seq = connection->snd_start_seq;
@@ -192,20 +380,20 @@ SPO_INLINE void spo_internal_handle_connection_init(spo_connection_data_t *conne
 SPO_INLINE void spo_internal_handle_next_data_sent(spo_connection_data_t *connection)
 {
     /* reset retransmission timer */
-    connection->snd_last_data_sent_time = spo_time_current();
+    connection->snd_last_data_sent_time = connection->host->time;
 }
 
 /* for each received packet */
 SPO_INLINE void spo_internal_handle_new_data_received(spo_connection_data_t *connection)
 {
-    if (connection->snd_mandatory_packets < connection->host->configuration.max_consecutive_acknowledges)
+    if (connection->snd_mandatory_packets < connection->parameters.max_consecutive_acknowledges)
     {
         if (connection->snd_mandatory_packets == 0)
         {
             connection->snd_mandatory_packets = 1; /* send at least one confirming packet */
             connection->snd_mandatory_packets_skipped = 0;
         }
-        else if (connection->snd_mandatory_packets_skipped >= connection->host->configuration.skip_packets_before_acknowledgement)
+        else if (connection->snd_mandatory_packets_skipped >= connection->parameters.skip_packets_before_acknowledgement)
         {
             ++connection->snd_mandatory_packets;
             connection->snd_mandatory_packets_skipped = 0;
@@ -240,6 +428,126 @@ SPO_INLINE void spo_internal_handle_unknown_ack(spo_connection_data_t *connectio
     }
 }
 
+/* lost ranges: the holes between the acked packets from the retransmit cursor up to the last SACK,
+   retransmissions take them from the head, so picking the next one doesn't search the acks list */
+
+/* removes the ranges below 'seq' */
+SPO_INLINE void spo_internal_release_lost_ranges(spo_connection_data_t *connection, uint32_t seq)
+{
+    spo_index_t *lost_ranges = &connection->snd_lost_ranges;
+    spo_index_item_t *current = SPO_INDEX_FIRST(lost_ranges);
+
+    while (SPO_INDEX_VALID(lost_ranges, current) && SPO_WRAPPED_LESS(current->start, seq))
+    {
+        if (SPO_WRAPPED_LESS(seq, current->start + current->size))
+        {
+            /* the range is partially released */
+            current->size -= seq - current->start;
+            current->start = seq;
+            break;
+        }
+
+        current = spo_index_remove_item(lost_ranges, current);
+    }
+}
+
+SPO_INLINE spo_bool_t spo_internal_remove_lost_range(spo_connection_data_t *connection, uint32_t start, uint32_t end)
+{
+    spo_index_t *lost_ranges = &connection->snd_lost_ranges;
+    spo_index_item_t *current;
+    uint32_t current_end;
+
+    if (lost_ranges->length == 0)
+        return SPO_TRUE;
+
+    if (SPO_WRAPPED_LESS_EQ(start, SPO_INDEX_FIRST(lost_ranges)->start))
+    {
+        /* the usual case: retransmission or ACK of the head */
+        spo_internal_release_lost_ranges(connection, end);
+        return SPO_TRUE;
+    }
+
+    /* SACK of the data within the holes */
+    current = spo_index_find_pos_by_key(lost_ranges, start);
+
+    while (SPO_INDEX_VALID(lost_ranges, current) && SPO_WRAPPED_LESS(current->start, end))
+    {
+        current_end = current->start + current->size;
+
+        if (SPO_WRAPPED_LESS(current->start, start))
+        {
+            if (SPO_WRAPPED_LESS(end, current_end))
+            {
+                /* the range is split */
+                current->size = start - current->start;
+                return spo_index_insert_item_after(lost_ranges, current, end, current_end - end) != NULL;
+            }
+
+            if (SPO_WRAPPED_LESS(start, current_end))
+                current->size = start - current->start;
+
+            current = SPO_INDEX_NEXT(lost_ranges, current);
+        }
+        else if (SPO_WRAPPED_LESS(end, current_end))
+        {
+            current->size = current_end - end;
+            current->start = end;
+            break;
+        }
+        else
+            current = spo_index_remove_item(lost_ranges, current);
+    }
+
+    return SPO_TRUE;
+}
+
+/* the ranges are dropped if they can't be kept up to date, and they are built again on the next retransmission */
+SPO_INLINE void spo_internal_invalidate_lost_ranges(spo_connection_data_t *connection)
+{
+    spo_index_clear(&connection->snd_lost_ranges);
+    connection->snd_lost_ranges_valid = SPO_FALSE;
+}
+
+/* the holes are found again, when the retransmit cursor moves back or the ranges aren't kept */
+SPO_INLINE void spo_internal_rebuild_lost_ranges(spo_connection_data_t *connection)
+{
+    spo_index_t *lost_ranges = &connection->snd_lost_ranges;
+    spo_index_item_t *current = SPO_INDEX_FIRST(&connection->snd_acked_packets);
+    spo_index_item_t *last_range = NULL;
+    uint32_t seq = SPO_WRAPPED_MAX(connection->snd_retransmit_next_seq, connection->snd_start_seq);
+
+    spo_index_clear(lost_ranges);
+
+    while (SPO_INDEX_VALID(&connection->snd_acked_packets, current))
+    {
+        if (SPO_WRAPPED_LESS(seq, current->start))
+        {
+            last_range = spo_index_insert_item_after(lost_ranges, last_range, seq, current->start - seq);
+            if (last_range == NULL)
+            {
+                spo_internal_invalidate_lost_ranges(connection);
+                return;
+            }
+        }
+
+        seq = SPO_WRAPPED_MAX(seq, current->start + current->size);
+        current = SPO_INDEX_NEXT(&connection->snd_acked_packets, current);
+    }
+
+    /* after a timeout the data sent after the last SACK are lost too */
+    if (connection->snd_recovery_mode == SPO_RECOVERY_BY_TIMEOUT &&
+        SPO_WRAPPED_LESS(seq, connection->snd_recovery_point_seq))
+    {
+        if (spo_index_insert_item_after(lost_ranges, last_range, seq, connection->snd_recovery_point_seq - seq) == NULL)
+        {
+            spo_internal_invalidate_lost_ranges(connection);
+            return;
+        }
+    }
+
+    connection->snd_lost_ranges_valid = SPO_TRUE;
+}
+
 SPO_INLINE uint32_t spo_internal_recovery_retransmit_by_seq(spo_connection_data_t *connection, uint32_t seq)
 {
     /* don't retransmit if congestion window isn't big enough */
@@ -253,6 +561,8 @@ SPO_INLINE uint32_t spo_internal_recovery_retransmit_by_seq(spo_connection_data_
             /* 'snd_retransmit_next_seq' always points to the next data to retransmit */
             if (SPO_WRAPPED_LESS(connection->snd_retransmit_next_seq, seq + bytes_sent))
                 connection->snd_retransmit_next_seq = seq + bytes_sent;
+            if (!spo_internal_remove_lost_range(connection, seq, seq + bytes_sent))
+                spo_internal_invalidate_lost_ranges(connection);
 
             SPO_LOG("REC, retransmitted %u bytes, SEQ %u, decrease CWND to %u", bytes_sent, seq, connection->snd_cwnd_bytes);
             return bytes_sent;
@@ -262,18 +572,20 @@ SPO_INLINE uint32_t spo_internal_recovery_retransmit_by_seq(spo_connection_data_
     return 0;
 }
 
-SPO_INLINE uint32_t spo_internal_recovery_retransmit_next_data(spo_connection_data_t *connection)
+/* finds the next hole in the acks list, it's used while the lost ranges aren't kept */
+SPO_INLINE uint32_t spo_internal_recovery_retransmit_next_hole(spo_connection_data_t *connection)
 {
+    spo_index_t *acked_packets = &connection->snd_acked_packets;
     spo_index_item_t *send_after_item;
     uint32_t seq;
 
-    if (connection->snd_acked_packets.length == 0) /* acks list is empty */
+    if (acked_packets->length == 0) /* acks list is empty */
         return 0;
 
     seq = SPO_WRAPPED_MAX(connection->snd_retransmit_next_seq, connection->snd_start_seq);
 
     /* find position of the seq */
-    send_after_item = spo_index_find_pos_by_key(&connection->snd_acked_packets, seq);
+    send_after_item = spo_index_find_pos_by_key(acked_packets, seq);
 
     if (send_after_item == NULL)
     {
@@ -281,12 +593,10 @@ SPO_INLINE uint32_t spo_internal_recovery_retransmit_next_data(spo_connection_da
         return spo_internal_recovery_retransmit_by_seq(connection, seq);
     }
 
-    if (SPO_INDEX_VALID(&connection->snd_acked_packets,
-        SPO_INDEX_NEXT(&connection->snd_acked_packets, send_after_item))) /* not a last item */
+    if (SPO_INDEX_VALID(acked_packets, SPO_INDEX_NEXT(acked_packets, send_after_item))) /* not a last item */
     {
         /* before the tail */
-        spo_packet_desc_t *packet_desc = (spo_packet_desc_t *)send_after_item->data;
-        uint32_t packet_end = packet_desc->start + packet_desc->size;
+        uint32_t packet_end = send_after_item->start + send_after_item->size;
 
         if (SPO_WRAPPED_LESS(seq, packet_end))
             seq = packet_end;
@@ -297,6 +607,19 @@ SPO_INLINE uint32_t spo_internal_recovery_retransmit_next_data(spo_connection_da
     return 0;
 }
 
+SPO_INLINE uint32_t spo_internal_recovery_retransmit_next_data(spo_connection_data_t *connection)
+{
+    if (!connection->snd_lost_ranges_valid)
+        spo_internal_rebuild_lost_ranges(connection);
+    if (!connection->snd_lost_ranges_valid)
+        return spo_internal_recovery_retransmit_next_hole(connection);
+
+    if (connection->snd_lost_ranges.length == 0) /* nothing to retransmit before the last SACK */
+        return 0;
+
+    return spo_internal_recovery_retransmit_by_seq(connection, SPO_INDEX_FIRST(&connection->snd_lost_ranges)->start);
+}
+
 SPO_INLINE uint32_t spo_internal_recovery_send_next_data(spo_connection_data_t *connection)
 {
     /* send next data if congestion window allows this */
@@ -322,7 +645,7 @@ SPO_INLINE void spo_internal_update_ssthresh(spo_connection_data_t *connection,
 
     /* update slow start threshold */
     connection->snd_ssthresh_bytes = SPO_MAX(ssthresh_in_bytes,
-        connection->host->configuration.min_ssthresh_in_packets * SPO_MAX_PAYLOAD_SIZE);
+        connection->parameters.min_ssthresh_bytes);
 }
 
 SPO_INLINE spo_bool_t spo_internal_initiate_recovery_mode(spo_connection_data_t *connection, spo_recovery_mode_t mode)
@@ -331,7 +654,7 @@ SPO_INLINE spo_bool_t spo_internal_initiate_recovery_mode(spo_connection_data_t
     {
     case SPO_RECOVERY_BY_LOSS:
         if (connection->snd_recovery_mode == SPO_RECOVERY_OFF)
-            spo_internal_update_ssthresh(connection, connection->host->configuration.ssthresh_factor_on_loss_percent);
+            spo_internal_update_ssthresh(connection, connection->parameters.ssthresh_factor_on_loss_percent);
 
         /* update congestion window */
         connection->snd_cwnd_bytes = SPO_MAX(connection->snd_ssthresh_bytes,
@@ -339,10 +662,10 @@ SPO_INLINE spo_bool_t spo_internal_initiate_recovery_mode(spo_connection_data_t
         break;
     case SPO_RECOVERY_BY_TIMEOUT:
         if (connection->snd_recovery_mode == SPO_RECOVERY_OFF)
-            spo_internal_update_ssthresh(connection, connection->host->configuration.ssthresh_factor_on_timeout_percent);
+            spo_internal_update_ssthresh(connection, connection->parameters.ssthresh_factor_on_timeout_percent);
 
         /* reset congestion window */
-        connection->snd_cwnd_bytes = connection->host->configuration.cwnd_on_timeout_in_packets * SPO_MAX_PAYLOAD_SIZE;
+        connection->snd_cwnd_bytes = connection->parameters.cwnd_on_timeout_bytes;
         break;
     }
 
@@ -354,6 +677,7 @@ SPO_INLINE spo_bool_t spo_internal_initiate_recovery_mode(spo_connection_data_t
     connection->snd_recovery_point_seq = connection->snd_next_seq;
     connection->snd_retransmit_rescue_seq = connection->snd_start_seq;
     connection->snd_retransmit_next_seq = connection->snd_start_seq;
+    spo_internal_rebuild_lost_ranges(connection);
 
     SPO_LOG("ENTER REC, point is %u, set CWND to %u, set SSTHRESH to %u",
         connection->snd_recovery_point_seq, connection->snd_cwnd_bytes, connection->snd_ssthresh_bytes);
@@ -376,22 +700,24 @@ SPO_INLINE void spo_internal_terminate_recovery_mode(spo_connection_data_t *conn
         break;
     case SPO_RECOVERY_BY_TIMEOUT:
         /* enter slow start mode */
-        connection->snd_cwnd_bytes = connection->host->configuration.cwnd_on_timeout_in_packets * SPO_MAX_PAYLOAD_SIZE;
+        connection->snd_cwnd_bytes = connection->parameters.cwnd_on_timeout_bytes;
         SPO_LOG("EXIT RTO REC, CWND is %u, SSTHRESH is %u", connection->snd_cwnd_bytes, connection->snd_ssthresh_bytes);
         break;
     }
 
     /* terminate recovery mode */
     connection->snd_recovery_mode = SPO_RECOVERY_OFF;
+    spo_index_clear(&connection->snd_lost_ranges);
+    connection->snd_lost_ranges_valid = SPO_TRUE;
 }
 
 SPO_INLINE spo_bool_t spo_internal_initiate_slowstart_by_timeout(spo_connection_data_t *connection)
 {
     if (connection->snd_recovery_mode == SPO_RECOVERY_OFF)
-        spo_internal_update_ssthresh(connection, connection->host->configuration.ssthresh_factor_on_timeout_percent);
+        spo_internal_update_ssthresh(connection, connection->parameters.ssthresh_factor_on_timeout_percent);
 
     /* update congestion window */
-    connection->snd_cwnd_bytes = connection->host->configuration.cwnd_on_timeout_in_packets * SPO_MAX_PAYLOAD_SIZE;
+    connection->snd_cwnd_bytes = connection->parameters.cwnd_on_timeout_bytes;
 
     /* reset duplicate acks counter */
     connection->snd_duplicate_acks = 0;
@@ -445,7 +771,7 @@ SPO_INLINE void spo_internal_handle_sent_data_acknowledged(spo_connection_data_t
         {
             /* slow start */
             uint32_t max_cwnd_increment_in_bytes =
-                connection->host->configuration.max_cwnd_inc_on_slowstart_in_packets * SPO_MAX_PAYLOAD_SIZE;
+                connection->parameters.max_cwnd_inc_on_slowstart_bytes;
 
             spo_internal_increase_cwnd_by_bytes(connection, SPO_MIN(bytes_sent, max_cwnd_increment_in_bytes));
             SPO_LOG("SLOW START, increase CWND to %u", connection->snd_cwnd_bytes);
@@ -466,7 +792,7 @@ SPO_INLINE void spo_internal_handle_sent_data_acknowledged(spo_connection_data_t
     /* reset duplicate acknowledges counter */
     connection->snd_duplicate_acks = 0;
     /* reset retransmission timer */
-    connection->snd_last_data_sent_time = spo_time_current();
+    connection->snd_last_data_sent_time = connection->host->time;
 }
 
 SPO_INLINE spo_bool_t spo_internal_recovery_data_transmission(spo_connection_data_t *connection)
@@ -475,7 +801,7 @@ SPO_INLINE spo_bool_t spo_internal_recovery_data_transmission(spo_connection_dat
     if (spo_internal_recovery_retransmit_next_data(connection) > 0)
         return SPO_TRUE;
 
-    if (connection->snd_duplicate_acks >= connection->host->configuration.duplicate_acks_for_retransmit)
+    if (connection->snd_duplicate_acks >= connection->parameters.duplicate_acks_for_retransmit)
     {
         if (SPO_WRAPPED_LESS(connection->snd_retransmit_rescue_seq, connection->snd_retransmit_next_seq))
         {
@@ -504,7 +830,7 @@ SPO_INLINE spo_bool_t spo_internal_recovery_data_transmission(spo_connection_dat
 
 SPO_INLINE spo_bool_t spo_internal_data_transmission(spo_connection_data_t *connection)
 {
-    if (connection->snd_duplicate_acks >= connection->host->configuration.duplicate_acks_for_retransmit)
+    if (connection->snd_duplicate_acks >= connection->parameters.duplicate_acks_for_retransmit)
     {
         /* it seems like some packets are lost */
         return spo_internal_initiate_recovery_mode(connection, SPO_RECOVERY_BY_LOSS);
@@ -528,10 +854,11 @@ SPO_INLINE spo_bool_t spo_internal_data_transmission(spo_connection_data_t *conn
 
 SPO_INLINE spo_bool_t spo_internal_process_retransmission_timer(spo_connection_data_t *connection)
 {
-    if (spo_time_elapsed(connection->snd_last_data_sent_time) >= connection->host->configuration.data_retransmission_timeout)
+    if (spo_internal_time_elapsed(connection->host, connection->snd_last_data_sent_time,
+        connection->parameters.data_retransmission_timeout))
     {
         /* reset retransmission timer */
-        connection->snd_last_data_sent_time = spo_time_current();
+        connection->snd_last_data_sent_time = connection->host->time;
 
         if (connection->snd_recovery_mode != SPO_RECOVERY_OFF)
         {
@@ -577,9 +904,11 @@ SPO_INLINE spo_bool_t spo_internal_handle_data_transmission(spo_connection_data_
 
 /* events */
 
+/* idle pooled connections don't fire events, nobody knows about them yet */
+
 SPO_INLINE void spo_internal_fire_connected_event(spo_connection_data_t *connection)
 {
-    if (connection->host->callbacks.connected != NULL)
+    if (connection->cold.pool == NULL && connection->host->callbacks.connected != NULL)
         connection->host->callbacks.connected(connection->host, connection);
 }
 
@@ -603,10 +932,24 @@ SPO_INLINE void spo_internal_fire_connection_lost_event(spo_connection_data_t *c
 
 SPO_INLINE void spo_internal_fire_incoming_data_event(spo_connection_data_t *connection, uint32_t data_size)
 {
-    if (connection->host->callbacks.incoming_data != NULL)
+    if (connection->cold.pool == NULL && connection->host->callbacks.incoming_data != NULL)
         connection->host->callbacks.incoming_data(connection->host, connection, data_size);
 }
 
+SPO_INLINE void spo_internal_fire_send_completion_event(spo_connection_data_t *connection,
+    const spo_send_buffer_t *buffer, spo_bool_t delivered)
+{
+    if (buffer->completion != NULL)
+        buffer->completion(connection, buffer->context, delivered);
+}
+
+SPO_INLINE void spo_internal_fire_receive_completion_event(spo_connection_data_t *connection,
+    const spo_receive_buffer_t *buffer, spo_bool_t filled)
+{
+    if (buffer->completion != NULL)
+        buffer->completion(connection, buffer->context, filled);
+}
+
 /* connection search */
 
 SPO_INLINE spo_connection_data_t *spo_internal_find_started_connection(spo_host_data_t *host, const spo_net_address_t *remote_address)
@@ -658,7 +1001,7 @@ SPO_INLINE spo_connection_data_t *spo_internal_find_oldest_incoming_connection(s
 
         if (oldest == NULL)
             oldest = connection;
-        else if (SPO_WRAPPED_LESS(connection->created_time, oldest->created_time))
+        else if (connection->cold.created_time < oldest->cold.created_time)
             oldest = connection;
 
         current = SPO_LIST_NEXT(&host->incoming_connections, current);
@@ -703,1146 +1046,2742 @@ SPO_INLINE void spo_internal_unpack_acks(spo_packet_desc_t *acks_list, const uin
     }
 }
 
-SPO_INLINE unsigned spo_internal_get_acks(spo_packet_desc_t *acks_list, spo_connection_data_t *connection)
+/* receive scoreboard: out-of-order data are tracked either by the sorted intervals
+   or by the bitmap over the receive window, which starts right after the ready data */
+
+SPO_INLINE spo_bool_t spo_internal_has_out_of_order_data(const spo_connection_data_t *connection)
 {
-    spo_packet_desc_t *packet;
-    unsigned count = 0;
-    spo_index_item_t *current = SPO_INDEX_FIRST(&connection->rcv_packets);
+    if (connection->parameters.receive_bitmap)
+        return connection->rcv_bitmap.length > 0;
 
-    while (SPO_INDEX_VALID(&connection->rcv_packets, current) && count < SPO_PACKET_MAX_SACKS)
-    {
-        packet = (spo_packet_desc_t *)current->data;
+    return connection->rcv_packets.length > 0;
+}
 
-        acks_list[count].start = packet->start;
-        acks_list[count].size = packet->size;
+SPO_INLINE spo_bool_t spo_internal_save_received_data(spo_connection_data_t *connection, uint32_t start, uint32_t size)
+{
+    connection->rcv_sacks_valid = SPO_FALSE;
 
-        ++count;
-        current = SPO_INDEX_NEXT(&connection->rcv_packets, current);
+    if (connection->parameters.receive_bitmap)
+    {
+        uint32_t win_start_seq = connection->rcv_start_seq + connection->rcv_bytes_ready;
+        return spo_bitmap_set_range(&connection->rcv_bitmap, start - win_start_seq, size);
     }
 
-    return count;
+    return spo_index_merge_item(&connection->rcv_packets, start, size);
 }
 
-SPO_INLINE spo_bool_t spo_internal_send_reset_packet(spo_host_data_t *host,
-    const spo_net_address_t *dst_address, uint16_t src_port, uint16_t dst_port, uint32_t seq, uint32_t ack)
+/* iterates over the received ranges in the seq order, 'position' must be 0 for the first one */
+SPO_INLINE spo_bool_t spo_internal_next_received_range(const spo_connection_data_t *connection,
+    uint32_t *position, spo_packet_desc_t *range)
 {
-    uint8_t packet_data[SPO_NET_MAX_PACKET_SIZE];
-    spo_packet_header_t *packet_header = (spo_packet_header_t *)packet_data;
+    if (connection->parameters.receive_bitmap)
+    {
+        if (!spo_bitmap_find_run(&connection->rcv_bitmap, position, &range->size))
+            return SPO_FALSE;
 
-    packet_header->type = SPO_PACKET_RESET;
-    packet_header->sacks = 0;
-    packet_header->src_port = spo_internal_swap_2bytes(src_port);
-    packet_header->dst_port = spo_internal_swap_2bytes(dst_port);
-    packet_header->seq = spo_internal_swap_4bytes(seq);
-    packet_header->ack = spo_internal_swap_4bytes(ack);
+        range->start = connection->rcv_start_seq + connection->rcv_bytes_ready + *position;
+        *position += range->size;
+        return SPO_TRUE;
+    }
+
+    if (*position >= connection->rcv_packets.length)
+        return SPO_FALSE;
 
-    return spo_net_send(host->socket, packet_data, SPO_HEADER_SIZE(0), dst_address) >= SPO_HEADER_SIZE(0);
+    range->start = connection->rcv_packets.items[*position].start;
+    range->size = connection->rcv_packets.items[*position].size;
+    ++*position;
+    return SPO_TRUE;
 }
 
-SPO_INLINE uint32_t spo_internal_send_packet(spo_connection_data_t *connection,
-    spo_packet_type_t packet_type, uint32_t seq, const uint8_t *data, uint32_t data_size)
+/* out-of-order data start after the ready data, older part of the packet is already delivered */
+SPO_INLINE uint32_t spo_internal_get_out_of_order_offset(spo_connection_data_t *connection,
+    const spo_packet_desc_t *range, uint32_t *size)
 {
-    uint8_t packet_data[SPO_NET_MAX_PACKET_SIZE];
-    spo_packet_desc_t acks_list[SPO_PACKET_MAX_SACKS];
-    unsigned acks_count;
-    uint32_t bytes_sent;
-    uint32_t header_size;
-    spo_packet_header_t *packet_header = (spo_packet_header_t *)packet_data;
-
-    acks_count = spo_internal_get_acks(acks_list, connection);
+    uint32_t win_start_seq = connection->rcv_start_seq + connection->rcv_bytes_ready;
+    uint32_t start_seq = range->start;
+    uint32_t end_seq = range->start + range->size;
 
-    packet_header->type = packet_type;
-    packet_header->sacks = (uint8_t)acks_count;
-    packet_header->src_port = spo_internal_swap_2bytes(connection->local_port);
-    packet_header->dst_port = spo_internal_swap_2bytes(connection->remote_port);
-    packet_header->seq = spo_internal_swap_4bytes(seq);
-    packet_header->ack = spo_internal_swap_4bytes(connection->rcv_start_seq);
+    if (SPO_WRAPPED_LESS(start_seq, win_start_seq))
+        start_seq = win_start_seq;
 
-    if (acks_count > 0)
-        spo_internal_pack_acks(packet_data + sizeof(spo_packet_header_t), acks_list, acks_count);
+    *size = SPO_WRAPPED_LESS(start_seq, end_seq) ? end_seq - start_seq : 0;
+    return start_seq - connection->rcv_start_seq;
+}
 
-    header_size = SPO_HEADER_SIZE(acks_count);
+/* removes the ranges which continue the ready data, returns count of the new in-order bytes */
+SPO_INLINE uint32_t spo_internal_consume_received_ranges(spo_connection_data_t *connection)
+{
+    uint32_t packet_end;
+    uint32_t expected_seq;
+    uint32_t bytes_received = 0;
+    spo_index_item_t *current;
 
-    if (data_size > 0)
+    if (connection->parameters.receive_bitmap)
     {
-        uint32_t max_payload_size = SPO_NET_MAX_PACKET_SIZE - header_size;
-        if (data_size > max_payload_size)
-            data_size = max_payload_size;
+        bytes_received = spo_bitmap_consume_prefix(&connection->rcv_bitmap);
+        if (bytes_received > 0)
+            connection->rcv_sacks_valid = SPO_FALSE;
 
-        memcpy(packet_data + header_size, data, data_size);
+        return bytes_received;
     }
 
-    bytes_sent = spo_net_send(connection->host->socket, packet_data, data_size + header_size, &connection->remote_address);
-    if (bytes_sent >= header_size)
+    current = SPO_INDEX_FIRST(&connection->rcv_packets);
+
+    while (SPO_INDEX_VALID(&connection->rcv_packets, current))
     {
-        connection->snd_last_packet_time = spo_time_current();
-        if (connection->snd_mandatory_packets > 0)
-            --connection->snd_mandatory_packets;
+        packet_end = current->start + current->size;
+        expected_seq = connection->rcv_start_seq + connection->rcv_bytes_ready + bytes_received;
+
+        if (SPO_WRAPPED_LESS(expected_seq, current->start)) /* a hole in the data */
+            break;
+
+        if (SPO_WRAPPED_LESS(expected_seq, packet_end)) /* packet has new data */
+            bytes_received += (packet_end - expected_seq);
+
+        /* one more case: it is an old packet, so we can simply destroy it */
 
-        return (bytes_sent - header_size);
+        current = spo_index_remove_item(&connection->rcv_packets, current);
+        connection->rcv_sacks_valid = SPO_FALSE;
     }
 
-    return 0;
+    return bytes_received;
 }
 
-SPO_INLINE uint32_t spo_internal_send_data_packets(spo_connection_data_t *connection,
-    uint32_t start_seq, uint32_t max_packets, const uint8_t *data, uint32_t data_size)
+/* finds the received range which contains 'seq' */
+SPO_INLINE spo_bool_t spo_internal_find_received_range(spo_connection_data_t *connection,
+    uint32_t seq, spo_packet_desc_t *range)
 {
-    uint32_t bytes_sent;
-    uint32_t total_bytes_sent = 0;
+    uint32_t win_start_seq = connection->rcv_start_seq + connection->rcv_bytes_ready;
+    uint32_t offset = seq - win_start_seq;
+    spo_index_item_t *item;
 
-    while (total_bytes_sent < data_size && max_packets > 0)
+    if (offset >= connection->parameters.buf_size) /* out of the window */
+        return SPO_FALSE;
+
+    if (connection->parameters.receive_bitmap)
     {
-        bytes_sent = spo_internal_send_packet(connection, SPO_PACKET_DATA,
-            start_seq + total_bytes_sent, data + total_bytes_sent, data_size - total_bytes_sent);
-        if (bytes_sent == 0) /* can't send data */
-            break;
+        if (!spo_bitmap_get_run(&connection->rcv_bitmap, &offset, &range->size))
+            return SPO_FALSE;
 
-        total_bytes_sent += bytes_sent;
-        --max_packets;
+        range->start = win_start_seq + offset;
+        return SPO_TRUE;
     }
 
-    return total_bytes_sent;
+    item = spo_index_find_pos_by_key(&connection->rcv_packets, seq);
+    if (item == NULL || SPO_WRAPPED_LESS_EQ(item->start + item->size, seq))
+        return SPO_FALSE;
+
+    range->start = item->start;
+    range->size = item->size;
+    return SPO_TRUE;
 }
 
-SPO_INLINE uint32_t spo_internal_send_data(spo_connection_data_t *connection, const uint8_t *data, uint32_t data_size)
+/* returns the position of the first range starting at or after 'seq' for 'spo_internal_next_received_range' */
+SPO_INLINE uint32_t spo_internal_get_received_position(spo_connection_data_t *connection, uint32_t seq)
 {
-    /* don't allow sending data over the unestablished connection */
-    if (connection->state == SPO_CONNECTION_STATE_CONNECTED)
-    {
-        uint32_t max_bytes_to_send = connection->host->configuration.connection_buf_size - connection->snd_buf_bytes;
-        if (max_bytes_to_send > 0)
-        {
-            uint32_t bytes_to_send = SPO_MIN(data_size, max_bytes_to_send);
-            uint32_t buf_size_required = connection->snd_buf_bytes + bytes_to_send;
-
-            if (buf_size_required > connection->snd_buf_size)
-            {
-                uint8_t *new_buffer = (uint8_t *)realloc(connection->snd_buf, buf_size_required);
-                if (new_buffer == NULL)
-                    return 0; /* can't allocate enough space */
-
-                connection->snd_buf_size = buf_size_required;
-                connection->snd_buf = new_buffer;
-            }
+    uint32_t win_start_seq = connection->rcv_start_seq + connection->rcv_bytes_ready;
+    uint32_t offset = seq - win_start_seq;
+    uint32_t run_offset = offset;
+    uint32_t size;
+    spo_index_item_t *item;
 
-            memcpy(connection->snd_buf + connection->snd_buf_bytes, data, bytes_to_send);
-            connection->snd_buf_bytes += bytes_to_send;
+    if (connection->parameters.receive_bitmap)
+    {
+        /* skip the rest of the range which contains 'seq' */
+        if (spo_bitmap_get_run(&connection->rcv_bitmap, &run_offset, &size) && run_offset < offset)
+            return run_offset + size;
 
-            return bytes_to_send;
-        }
+        return offset;
     }
 
-    return 0;
+    item = spo_index_find_pos_by_key(&connection->rcv_packets, seq);
+    if (item == NULL)
+        return 0;
+
+    return (uint32_t)(item - connection->rcv_packets.items) + (item->start == seq ? 0 : 1);
 }
 
-SPO_INLINE uint32_t spo_internal_read_data(spo_connection_data_t *connection, uint8_t *buf, uint32_t buf_size)
+/* the range with the most recently received data goes first, so the sender learns about the new data
+   even if there are more ranges than SACKs, the other SACKs rotate over the rest of the ranges (RFC 2018) */
+SPO_INLINE unsigned spo_internal_get_acks(spo_packet_desc_t *acks_list, spo_connection_data_t *connection)
 {
-    /* don't allow reading data from the unestablished connection */
-    if (connection->state == SPO_CONNECTION_STATE_CONNECTED)
+    unsigned count = 0;
+    uint32_t position;
+    uint32_t last_seq = connection->rcv_last_data_seq;
+    uint32_t first_seq = connection->rcv_sack_next_seq;
+    uint32_t win_start_seq = connection->rcv_start_seq + connection->rcv_bytes_ready;
+    spo_bool_t has_last_range;
+    spo_bool_t wrapped = SPO_FALSE;
+    spo_packet_desc_t range;
+
+    if (!spo_internal_has_out_of_order_data(connection))
+        return 0;
+
+    has_last_range = spo_internal_find_received_range(connection, last_seq, &acks_list[0]);
+    if (has_last_range)
+        ++count;
+
+    if (first_seq - win_start_seq >= connection->parameters.buf_size) /* the ranges were consumed */
+        first_seq = win_start_seq;
+
+    position = spo_internal_get_received_position(connection, first_seq);
+
+    while (count < SPO_PACKET_MAX_SACKS)
     {
-        if (connection->rcv_bytes_ready > 0)
+        if (!spo_internal_next_received_range(connection, &position, &range))
         {
-            uint32_t bytes_to_read = SPO_MIN(connection->rcv_bytes_ready, buf_size);
-
-            memcpy(buf, connection->rcv_buf, bytes_to_read);
-            /* shift receive buffer */
-            memmove(connection->rcv_buf, connection->rcv_buf + bytes_to_read,
-                connection->host->configuration.connection_buf_size - bytes_to_read);
-            connection->rcv_start_seq += bytes_to_read;
-            connection->rcv_bytes_ready -= bytes_to_read;
+            if (wrapped)
+                break;
 
-            return bytes_to_read;
+            /* continue from the first range */
+            wrapped = SPO_TRUE;
+            position = 0;
+            continue;
         }
+
+        if (wrapped && SPO_WRAPPED_LESS_EQ(first_seq, range.start)) /* all the ranges are reported */
+            break;
+
+        if (has_last_range && SPO_WRAPPED_LESS_EQ(range.start, last_seq) &&
+            SPO_WRAPPED_LESS(last_seq, range.start + range.size))
+            continue;
+
+        acks_list[count++] = range;
+        connection->rcv_sack_next_seq = range.start + range.size;
     }
 
-    return 0;
+    return count;
 }
 
-/* connections management */
-
-SPO_INLINE uint16_t spo_internal_get_port_from_pool(spo_host_data_t *host)
+/* bulk senders rarely receive anything, so the SACKs are encoded once and copied into each packet */
+SPO_INLINE unsigned spo_internal_get_packed_acks(spo_connection_data_t *connection)
 {
-    uint16_t port;
-    uint16_t ports_available[UINT16_MAX];
-    uint16_t ports_count = 0;
+    spo_packet_desc_t acks_list[SPO_PACKET_MAX_SACKS];
 
-    /* find available ports, first and last ports are reserved */
-    for (port = 1; port < UINT16_MAX; ++port)
+    if (!connection->rcv_sacks_valid)
     {
-        if (host->connections_by_ports[port] == NULL)
-            ports_available[ports_count++] = port;
+        connection->rcv_sacks_count = (uint8_t)spo_internal_get_acks(acks_list, connection);
+        spo_internal_pack_acks((uint8_t *)connection->rcv_sacks, acks_list, connection->rcv_sacks_count);
+        connection->rcv_sacks_valid = SPO_TRUE;
     }
-    if (ports_count == 0)
-        return 0;
 
-    return ports_available[spo_random_next() % ports_count];
+    return connection->rcv_sacks_count;
 }
 
-SPO_INLINE spo_bool_t spo_internal_allocate_connection_buffers(spo_connection_data_t *connection)
+/* sends a packet which doesn't belong to any connection */
+SPO_INLINE spo_bool_t spo_internal_send_stateless_packet(spo_host_data_t *host, spo_packet_type_t packet_type,
+    const spo_net_address_t *dst_address, uint16_t src_port, uint16_t dst_port, uint32_t seq, uint32_t ack)
 {
-    connection->rcv_buf = (uint8_t *)malloc(connection->host->configuration.connection_buf_size);
-    if (connection->rcv_buf == NULL)
-        return SPO_FALSE;
+    uint8_t packet_data[SPO_NET_MAX_PACKET_SIZE];
+    spo_packet_header_t *packet_header = (spo_packet_header_t *)packet_data;
+
+    packet_header->type = packet_type;
+    packet_header->sacks = 0;
+    packet_header->src_port = spo_internal_swap_2bytes(src_port);
+    packet_header->dst_port = spo_internal_swap_2bytes(dst_port);
+    packet_header->seq = spo_internal_swap_4bytes(seq);
+    packet_header->ack = spo_internal_swap_4bytes(ack);
 
-    connection->snd_buf = NULL; /* lazy allocation */
+    if (spo_net_send(host->socket, packet_data, SPO_HEADER_SIZE(0), dst_address) >= SPO_HEADER_SIZE(0))
+    {
+        ++host->packets_sent;
+        return SPO_TRUE;
+    }
 
-    return SPO_TRUE;
+    return SPO_FALSE;
 }
 
-SPO_INLINE void spo_internal_destroy_connection(spo_connection_data_t *connection)
+SPO_INLINE spo_bool_t spo_internal_send_reset_packet(spo_host_data_t *host,
+    const spo_net_address_t *dst_address, uint16_t src_port, uint16_t dst_port, uint32_t seq, uint32_t ack)
 {
-    spo_index_item_t *current;
+    return spo_internal_send_stateless_packet(host, SPO_PACKET_RESET, dst_address, src_port, dst_port, seq, ack);
+}
 
-    /* release port */
-    connection->host->connections_by_ports[connection->local_port] = NULL;
+/* ranges of the user buffers are read from them, the rest of the data from the segments */
+SPO_INLINE void spo_internal_read_send_buffer(spo_connection_data_t *connection, uint32_t pos, uint8_t *data, uint32_t size)
+{
+    uint32_t bytes_to_read;
+    uint32_t seq = connection->snd_start_seq + pos;
+    spo_send_buffer_t *buffer = connection->snd_user_buffers;
 
-    /* destroy buffers */
-    current = SPO_INDEX_FIRST(&connection->rcv_packets);
-    while (SPO_INDEX_VALID(&connection->rcv_packets, current))
+    while (size > 0)
     {
-        free(current->data);
-        current = SPO_INDEX_NEXT(&connection->rcv_packets, current);
-    }
-    spo_index_destroy(&connection->rcv_packets);
+        while (buffer != NULL && SPO_WRAPPED_LESS_EQ(buffer->start_seq + buffer->size, seq))
+            buffer = buffer->next_buffer;
 
-    current = SPO_INDEX_FIRST(&connection->snd_acked_packets);
-    while (SPO_INDEX_VALID(&connection->snd_acked_packets, current))
-    {
-        free(current->data);
-        current = SPO_INDEX_NEXT(&connection->snd_acked_packets, current);
-    }
-    spo_index_destroy(&connection->snd_acked_packets);
+        if (buffer != NULL && SPO_WRAPPED_LESS_EQ(buffer->start_seq, seq))
+        {
+            bytes_to_read = SPO_MIN(size, buffer->start_seq + buffer->size - seq);
+            memcpy(data, buffer->data + (seq - buffer->start_seq), bytes_to_read);
+        }
+        else
+        {
+            bytes_to_read = (buffer != NULL) ? SPO_MIN(size, buffer->start_seq - seq) : size;
+            spo_segment_chain_read(&connection->snd_buf, seq - connection->snd_start_seq, data, bytes_to_read);
+        }
 
-    if (connection->rcv_buf != NULL)
-    {
-        free(connection->rcv_buf);
-        connection->rcv_buf = NULL;
-    }
-    if (connection->snd_buf != NULL)
-    {
-        free(connection->snd_buf);
-        connection->snd_buf = NULL;
+        data += bytes_to_read;
+        seq += bytes_to_read;
+        size -= bytes_to_read;
     }
 }
 
-SPO_INLINE void spo_internal_terminate_connection(spo_connection_data_t *connection)
+/* payload is taken from the send buffer at 'data_pos', 'data_size' is NULL if the packet has no payload,
+   otherwise it's replaced with count of the payload bytes sent */
+SPO_INLINE spo_bool_t spo_internal_send_packet(spo_connection_data_t *connection,
+    spo_packet_type_t packet_type, uint32_t seq, uint32_t data_pos, uint32_t *data_size)
 {
-    spo_connection_state_t state = connection->state;
+    uint8_t packet_data[SPO_NET_MAX_PACKET_SIZE];
+    unsigned acks_count;
+    uint32_t bytes_sent;
+    uint32_t header_size;
+    uint32_t payload_size = 0;
+    spo_packet_header_t *packet_header = (spo_packet_header_t *)packet_data;
 
-    /* first, mark connection as closed */
-    connection->state = SPO_CONNECTION_STATE_CLOSED;
+    acks_count = spo_internal_get_packed_acks(connection);
 
-    switch (state)
-    {
-    case SPO_CONNECTION_STATE_CONNECT_STARTED:
-        /* remove connection from 'started_connections' list */
-        spo_list_remove_items_by_data(&connection->host->started_connections, connection);
+    packet_header->type = packet_type;
+    packet_header->sacks = (uint8_t)acks_count;
+    packet_header->src_port = spo_internal_swap_2bytes(connection->local_port);
+    packet_header->dst_port = spo_internal_swap_2bytes(connection->remote_port);
+    packet_header->seq = spo_internal_swap_4bytes(seq);
+    packet_header->ack = spo_internal_swap_4bytes(connection->rcv_start_seq);
 
-        /* fall through */
-    case SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED:
-        /* it was a started connection, so notify the user code */
-        spo_internal_fire_unable_to_connect_event(connection);
-        spo_internal_destroy_connection(connection);
-        break;
-    case SPO_CONNECTION_STATE_CONNECT_RECEIVED:
-        /* remove connection from 'incoming_connections' list */
-        spo_list_remove_items_by_data(&connection->host->incoming_connections, connection);
+    if (acks_count > 0)
+        memcpy(packet_data + sizeof(spo_packet_header_t), connection->rcv_sacks, acks_count * sizeof(spo_packet_header_sack_t));
 
-        spo_internal_destroy_connection(connection);
-        /* we must entirely destroy such connections because the user code doesn't know about them */
-        free(connection);
-        break;
-    case SPO_CONNECTION_STATE_CONNECTED:
-        spo_internal_fire_connection_lost_event(connection);
-        spo_internal_destroy_connection(connection);
-        break;
-    case SPO_CONNECTION_STATE_INIT:
-        /* remove connection from 'connections' list */
-        /* in other cases connections are removed via 'spo_internal_process_connections' function */
-        spo_list_remove_items_by_data(&connection->host->connections, connection);
+    header_size = SPO_HEADER_SIZE(acks_count);
 
-        spo_internal_destroy_connection(connection);
-        /* we must entirely destroy such connections because the user code doesn't know about them */
-        free(connection);
-        break;
+    if (data_size != NULL)
+    {
+        payload_size = SPO_MIN(*data_size, SPO_NET_MAX_PACKET_SIZE - header_size);
+        spo_internal_read_send_buffer(connection, data_pos, packet_data + header_size, payload_size);
+        *data_size = 0;
     }
-}
 
-SPO_INLINE void spo_internal_init_connection(spo_connection_data_t *connection, spo_host_data_t *host, uint16_t port)
-{
-    memset(connection, 0, sizeof(spo_connection_data_t));
-    connection->host = host;
-    connection->state = SPO_CONNECTION_STATE_INIT;
-    connection->created_time = spo_time_current();
-    connection->local_port = port;
-    connection->snd_start_seq = spo_random_next();
-    connection->snd_next_seq = connection->snd_start_seq;
-    spo_index_init(&connection->rcv_packets);
-    spo_index_init(&connection->snd_acked_packets);
+    bytes_sent = spo_net_send(connection->host->socket, packet_data, payload_size + header_size, &connection->remote_address);
+    if (bytes_sent >= header_size)
+    {
+        connection->snd_last_packet_time = connection->host->time;
+        if (connection->snd_mandatory_packets > 0)
+            --connection->snd_mandatory_packets;
 
-    host->connections_by_ports[port] = connection;
-}
+        ++connection->host->packets_sent;
 
-SPO_INLINE spo_connection_data_t *spo_internal_reuse_oldest_connection(spo_host_data_t *host)
-{
-    spo_connection_data_t *connection = spo_internal_find_oldest_incoming_connection(host);
-    if (connection == NULL)
-        return NULL;
+        if (data_size != NULL)
+            *data_size = bytes_sent - header_size;
 
-    spo_internal_destroy_connection(connection);
+        return SPO_TRUE;
+    }
 
-    spo_internal_init_connection(connection, host, connection->local_port);
-    return connection;
+    return SPO_FALSE;
 }
 
-SPO_INLINE spo_connection_data_t *spo_internal_allocate_connection(spo_host_data_t *host)
+SPO_INLINE uint32_t spo_internal_send_data_packets(spo_connection_data_t *connection,
+    uint32_t start_seq, uint32_t max_packets, uint32_t data_pos, uint32_t data_size)
 {
-    spo_connection_data_t *connection;
-    uint16_t port;
+    uint32_t bytes_sent;
+    uint32_t total_bytes_sent = 0;
 
-    if (host->connections.length >= host->configuration.max_connections)
+    while (total_bytes_sent < data_size && max_packets > 0)
     {
-        /* try to reuse the oldest connection */
-        return spo_internal_reuse_oldest_connection(host);
-    }
+        bytes_sent = data_size - total_bytes_sent;
+        if (!spo_internal_send_packet(connection, SPO_PACKET_DATA, start_seq + total_bytes_sent,
+            data_pos + total_bytes_sent, &bytes_sent) || bytes_sent == 0) /* can't send data */
+            break;
 
-    port = spo_internal_get_port_from_pool(host);
-    if (port == 0) /* all ports are busy */
-    {
-        /* try to reuse the oldest connection */
-        return spo_internal_reuse_oldest_connection(host);
+        total_bytes_sent += bytes_sent;
+        --max_packets;
     }
 
-    /* create new connection */
-    connection = (spo_connection_data_t *)malloc(sizeof(spo_connection_data_t));
-    if (connection == NULL)
-        return NULL;
+    return total_bytes_sent;
+}
 
-    if (spo_list_add_item(&host->connections, connection) == NULL)
+SPO_INLINE uint32_t spo_internal_send_data(spo_connection_data_t *connection, const uint8_t *data, uint32_t data_size)
+{
+    /* don't allow sending data over the unestablished connection */
+    if (connection->state == SPO_CONNECTION_STATE_CONNECTED)
     {
-        free(connection);
-        return NULL;
+        uint32_t max_bytes_to_send = connection->parameters.buf_size - connection->snd_buf_bytes;
+        if (max_bytes_to_send > 0)
+        {
+            /* accepts less data if the buffers memory limit is reached */
+            uint32_t bytes_to_send = spo_segment_chain_write(&connection->snd_buf, &connection->host->segments_pool,
+                connection->snd_buf_bytes, data, SPO_MIN(data_size, max_bytes_to_send), SPO_FALSE);
+
+            connection->snd_buf_bytes += bytes_to_send;
+            return bytes_to_send;
+        }
     }
 
-    spo_internal_init_connection(connection, host, port);
-    return connection;
+    return 0;
 }
 
-/* network packets processing */
-
-SPO_INLINE spo_index_item_t *spo_internal_insert_packet_desc(spo_index_t *list,
-    spo_index_item_t *after_item, const spo_packet_desc_t *packet_desc)
+SPO_INLINE uint32_t spo_internal_send_user_data(spo_connection_data_t *connection, const uint8_t *data, uint32_t data_size,
+    spo_send_completion_t completion, void *context)
 {
-    spo_index_item_t *new_item;
-    spo_packet_desc_t *packet_to_insert = (spo_packet_desc_t *)malloc(sizeof(spo_packet_desc_t));
+    spo_send_buffer_t *buffer;
+    uint32_t bytes_to_send;
 
-    if (packet_to_insert == NULL)
-        return NULL;
+    /* don't allow sending data over the unestablished connection */
+    if (connection->state != SPO_CONNECTION_STATE_CONNECTED)
+        return 0;
+
+    bytes_to_send = SPO_MIN(data_size, connection->parameters.buf_size - connection->snd_buf_bytes);
+    if (bytes_to_send == 0)
+        return 0;
+
+    buffer = (spo_send_buffer_t *)spo_slab_alloc(&connection->host->send_buffers_slab);
+    if (buffer == NULL)
+        return 0;
+
+    /* the data take their place in the send buffer, but the segments aren't allocated for them */
+    buffer->next_buffer = NULL;
+    buffer->data = data;
+    buffer->start_seq = connection->snd_start_seq + connection->snd_buf_bytes;
+    buffer->size = bytes_to_send;
+    buffer->completion = completion;
+    buffer->context = context;
+
+    if (connection->snd_last_user_buffer != NULL)
+        connection->snd_last_user_buffer->next_buffer = buffer;
+    else
+        connection->snd_user_buffers = buffer;
+    connection->snd_last_user_buffer = buffer;
+
+    connection->snd_buf_bytes += bytes_to_send;
+    return bytes_to_send;
+}
 
-    *packet_to_insert = *packet_desc;
+SPO_INLINE uint32_t spo_internal_send_data_vector(spo_connection_data_t *connection, const spo_buffer_t *buffers, uint32_t count)
+{
+    uint32_t i;
+    uint32_t bytes_accepted;
+    uint32_t total_bytes_accepted = 0;
 
-    new_item = spo_index_insert_item_after(list, after_item, packet_to_insert->start, packet_to_insert);
-    if (new_item == NULL)
+    /* the buffers are appended one after another until the send buffer is full */
+    for (i = 0; i < count; ++i)
     {
-        free(packet_to_insert);
-        return NULL;
+        bytes_accepted = spo_internal_send_data(connection, buffers[i].data, buffers[i].size);
+        total_bytes_accepted += bytes_accepted;
+        if (bytes_accepted < buffers[i].size)
+            break;
     }
 
-    return new_item;
+    return total_bytes_accepted;
 }
 
-SPO_INLINE spo_bool_t spo_internal_merge_packet_desc(spo_index_t *list, const spo_packet_desc_t *packet)
+/* data of the posted buffers can't be read */
+SPO_INLINE uint32_t spo_internal_get_readable_bytes(const spo_connection_data_t *connection)
 {
-    uint32_t current_start;
-    uint32_t current_end;
-    uint32_t prev_end;
-    spo_packet_desc_t *prev_packet_desc;
-    spo_packet_desc_t *packet_desc;
-    spo_index_item_t *current;
+    const spo_receive_buffer_t *buffer = connection->rcv_posted_buffers;
 
-    /* search item after which a new item can be inserted */
-    current = spo_index_find_pos_by_key(list, packet->start);
-    if (current == NULL)
-    {
-        /* insert head */
-        current = spo_internal_insert_packet_desc(list, NULL, packet);
-        if (current == NULL)
-            return SPO_FALSE;
+    if (buffer == NULL)
+        return connection->rcv_bytes_ready;
+    if (SPO_WRAPPED_LESS_EQ(buffer->start_seq, connection->rcv_start_seq))
+        return 0;
 
-        prev_packet_desc = (spo_packet_desc_t *)current->data;
-        /* get the next item */
-        current = SPO_INDEX_NEXT(list, current);
-    }
-    else
-    {
-        prev_packet_desc = (spo_packet_desc_t *)current->data;
+    return SPO_MIN(connection->rcv_bytes_ready, buffer->start_seq - connection->rcv_start_seq);
+}
 
-        /* new packet is a current item */
-        current_start = packet->start;
-        current_end = current_start + packet->size;
-        prev_end = prev_packet_desc->start + prev_packet_desc->size;
+SPO_INLINE void spo_internal_release_read_data(spo_connection_data_t *connection, uint32_t bytes_read)
+{
+    /* release the segments which are read completely */
+    spo_segment_chain_consume(&connection->rcv_buf, &connection->host->segments_pool, bytes_read);
+    connection->rcv_start_seq += bytes_read;
+    connection->rcv_bytes_ready -= bytes_read;
+
+    /* don't keep the partially read segment of the empty buffer */
+    if (connection->rcv_bytes_ready == 0 && !spo_internal_has_out_of_order_data(connection))
+        spo_segment_chain_clear(&connection->rcv_buf, &connection->host->segments_pool);
+}
 
-        /* don't check for current_start >= prev_start as it's always true */
-        if (SPO_WRAPPED_LESS(prev_end, current_end))
-        {
-            if (SPO_WRAPPED_LESS(prev_end, current_start))
-            {
-                current = spo_internal_insert_packet_desc(list, current, packet);
-                if (current == NULL)
-                    return SPO_FALSE;
-                /* set new item as a previous item */
-                prev_packet_desc = (spo_packet_desc_t *)current->data;
-            }
-            else
-            {
-                /* new packet starts within previous and ends after the previous */
-                prev_packet_desc->size += (current_end - prev_end);
-            }
-            /* get the next item */
-            current = SPO_INDEX_NEXT(list, current);
-        }
-        else
+SPO_INLINE uint32_t spo_internal_read_data(spo_connection_data_t *connection, uint8_t *buf, uint32_t buf_size)
+{
+    /* don't allow reading data from the unestablished connection */
+    if (connection->state == SPO_CONNECTION_STATE_CONNECTED)
+    {
+        uint32_t bytes_ready = spo_internal_get_readable_bytes(connection);
+
+        if (bytes_ready > 0)
         {
-            /* previous item includes the current one */
-            /* merge is completed because nothing has changed */
-            return SPO_TRUE;
+            uint32_t bytes_to_read = SPO_MIN(bytes_ready, buf_size);
+
+            spo_segment_chain_read(&connection->rcv_buf, 0, buf, bytes_to_read);
+            spo_internal_release_read_data(connection, bytes_to_read);
+
+            return bytes_to_read;
         }
     }
 
-    /* items are sorted by start seq */
-    while (SPO_INDEX_VALID(list, current))
-    {
-        packet_desc = (spo_packet_desc_t *)current->data;
-
-        current_start = packet_desc->start;
-        current_end = current_start + packet_desc->size;
-        prev_end = prev_packet_desc->start + prev_packet_desc->size;
+    return 0;
+}
 
-        /* don't check for current_start >= prev_start as it's always true */
-        if (SPO_WRAPPED_LESS(prev_end, current_end))
-        {
-            if (SPO_WRAPPED_LESS(prev_end, current_start))
-            {
-                /* a hole in the data, merge is completed */
-                break;
-            }
-            /* current item starts within previous and ends after the previous */
-            prev_packet_desc->size += (current_end - prev_end);
-        }
-        /* else previous item includes the current one */
+SPO_INLINE void spo_internal_copy_to_posted_buffer(spo_connection_data_t *connection,
+    spo_receive_buffer_t *buffer, uint32_t seq, uint32_t size)
+{
+    uint32_t start_seq = SPO_WRAPPED_MAX(seq, buffer->start_seq);
+    uint32_t end_seq = SPO_WRAPPED_MIN(seq + size, buffer->start_seq + buffer->size);
 
-        free(packet_desc);
-        current = spo_index_remove_item(list, current);
+    if (SPO_WRAPPED_LESS(start_seq, end_seq))
+    {
+        spo_segment_chain_read(&connection->rcv_buf, start_seq - connection->rcv_start_seq,
+            buffer->data + (start_seq - buffer->start_seq), end_seq - start_seq);
     }
-
-    return SPO_TRUE;
 }
 
-SPO_INLINE spo_bool_t spo_internal_check_seq(spo_connection_data_t *connection, uint32_t seq)
+SPO_INLINE spo_bool_t spo_internal_post_receive_buffer(spo_connection_data_t *connection, uint8_t *data, uint32_t data_size,
+    spo_receive_completion_t completion, void *context)
 {
-    /* check if SEQ is in the valid range */
-    /* we should check previous SEQ numbers as the other side could send old SEQ before the new ACK is received */
-    uint32_t min_seq = connection->rcv_start_seq - connection->host->configuration.connection_buf_size;
-    uint32_t max_seq = connection->rcv_start_seq + connection->host->configuration.connection_buf_size - 1;
+    spo_receive_buffer_t *buffer;
+    spo_packet_desc_t range;
+    uint32_t position = 0;
+    uint32_t offset;
+    uint32_t size;
 
-    if (SPO_WRAPPED_LESS(seq, min_seq))
+    /* don't allow reading data from the unestablished connection */
+    if (connection->state != SPO_CONNECTION_STATE_CONNECTED || data_size == 0)
         return SPO_FALSE;
-    if (SPO_WRAPPED_LESS(max_seq, seq))
+
+    buffer = (spo_receive_buffer_t *)spo_slab_alloc(&connection->host->receive_buffers_slab);
+    if (buffer == NULL)
         return SPO_FALSE;
 
+    /* the buffer takes the data after the ones read or posted before */
+    buffer->next_buffer = NULL;
+    buffer->data = data;
+    buffer->start_seq = (connection->rcv_last_posted_buffer != NULL) ?
+        connection->rcv_last_posted_buffer->start_seq + connection->rcv_last_posted_buffer->size : connection->rcv_start_seq;
+    buffer->size = data_size;
+    buffer->completion = completion;
+    buffer->context = context;
+
+    /* the data received already are copied, the next ones are placed into the buffer directly */
+    spo_internal_copy_to_posted_buffer(connection, buffer, connection->rcv_start_seq, connection->rcv_bytes_ready);
+    while (spo_internal_next_received_range(connection, &position, &range))
+    {
+        offset = spo_internal_get_out_of_order_offset(connection, &range, &size);
+        spo_internal_copy_to_posted_buffer(connection, buffer, connection->rcv_start_seq + offset, size);
+    }
+
+    if (connection->rcv_last_posted_buffer != NULL)
+        connection->rcv_last_posted_buffer->next_buffer = buffer;
+    else
+        connection->rcv_posted_buffers = buffer;
+    connection->rcv_last_posted_buffer = buffer;
+
     return SPO_TRUE;
 }
 
-SPO_INLINE spo_bool_t spo_internal_check_ack(spo_connection_data_t *connection, uint32_t ack)
+SPO_INLINE uint32_t spo_internal_peek_data(spo_connection_data_t *connection, spo_buffer_t *spans, uint32_t max_spans)
 {
-    /* check if ACK is in the valid range */
-    /* we should check previous SEQ numbers to correctly process out-of-order packets */
-    uint32_t min_ack = connection->snd_start_seq - connection->host->configuration.connection_buf_size;
-    uint32_t max_ack = connection->snd_next_seq;
+    uint32_t bytes_ready;
+    uint32_t spans_count = 0;
+    uint32_t offset = 0;
 
-    if (SPO_WRAPPED_LESS(ack, min_ack))
-        return SPO_FALSE;
-    if (SPO_WRAPPED_LESS(max_ack, ack))
-        return SPO_FALSE;
+    /* don't allow reading data from the unestablished connection */
+    if (connection->state != SPO_CONNECTION_STATE_CONNECTED)
+        return 0;
 
-    return SPO_TRUE;
+    /* each span is the ready data stored in one segment */
+    bytes_ready = spo_internal_get_readable_bytes(connection);
+    while (spans_count < max_spans && offset < bytes_ready)
+    {
+        spans[spans_count].size = bytes_ready - offset;
+        spans[spans_count].data = spo_segment_chain_get_data(&connection->rcv_buf, offset, &spans[spans_count].size);
+        offset += spans[spans_count].size;
+        ++spans_count;
+    }
+
+    return spans_count;
 }
 
-SPO_INLINE spo_bool_t spo_internal_fill_rcv_buffer(spo_connection_data_t *connection, uint32_t seq, const uint8_t *data, uint32_t data_size)
+SPO_INLINE uint32_t spo_internal_consume_data(spo_connection_data_t *connection, uint32_t size)
 {
-    uint32_t common_start_seq;
-    uint32_t common_end_seq;
-    uint32_t common_data_size;
-
-    uint32_t win_start_seq = connection->rcv_start_seq + connection->rcv_bytes_ready;
-    uint32_t win_end_seq = connection->rcv_start_seq + connection->host->configuration.connection_buf_size;
-
-    uint32_t data_start_seq = seq;
-    uint32_t data_end_seq = data_start_seq + data_size;
-
-    /* check if the receive buffer can accept received packets */
-    if (SPO_WRAPPED_LESS_EQ(data_end_seq, win_start_seq))
-        return SPO_FALSE;
-    if (SPO_WRAPPED_LESS_EQ(win_end_seq, data_start_seq))
-        return SPO_FALSE;
+    uint32_t bytes_to_consume;
 
-    /* unsigned arithmetic does all the magic */
-    common_start_seq = SPO_WRAPPED_MAX(data_start_seq, win_start_seq);
-    common_end_seq = SPO_WRAPPED_MIN(win_end_seq, data_end_seq);
-    common_data_size = common_end_seq - common_start_seq;
-
-    if (common_data_size > 0)
-    {
-        uint32_t pos_in_buf;
-        uint32_t pos_in_data;
-        spo_packet_desc_t packet_desc;
+    /* don't allow reading data from the unestablished connection */
+    if (connection->state != SPO_CONNECTION_STATE_CONNECTED)
+        return 0;
 
-        pos_in_buf = common_start_seq - win_start_seq;
-        pos_in_data = common_start_seq - data_start_seq;
+    bytes_to_consume = SPO_MIN(spo_internal_get_readable_bytes(connection), size);
+    if (bytes_to_consume > 0)
+        spo_internal_release_read_data(connection, bytes_to_consume);
 
-        memcpy(connection->rcv_buf + pos_in_buf, data + pos_in_data, common_data_size);
+    return bytes_to_consume;
+}
 
-        /* save description of the new data */
-        packet_desc.start = common_start_seq;
-        packet_desc.size = common_data_size;
+SPO_INLINE uint32_t spo_internal_read_data_vector(spo_connection_data_t *connection, const spo_buffer_t *buffers, uint32_t count)
+{
+    uint32_t i;
+    uint32_t bytes_ready;
+    uint32_t bytes_to_read;
+    uint32_t bytes_read = 0;
 
-        if (spo_internal_merge_packet_desc(&connection->rcv_packets, &packet_desc) == SPO_FALSE)
-            return SPO_FALSE;
+    /* don't allow reading data from the unestablished connection */
+    if (connection->state != SPO_CONNECTION_STATE_CONNECTED)
+        return 0;
 
-        return SPO_TRUE;
+    /* the buffers are filled one after another, the segments are released once for all of them */
+    bytes_ready = spo_internal_get_readable_bytes(connection);
+    for (i = 0; i < count && bytes_read < bytes_ready; ++i)
+    {
+        bytes_to_read = SPO_MIN(bytes_ready - bytes_read, buffers[i].size);
+        spo_segment_chain_read(&connection->rcv_buf, bytes_read, buffers[i].data, bytes_to_read);
+        bytes_read += bytes_to_read;
     }
 
-    return SPO_FALSE;
+    if (bytes_read > 0)
+        spo_internal_release_read_data(connection, bytes_read);
+
+    return bytes_read;
 }
 
-SPO_INLINE uint32_t spo_internal_remove_acknowledged_packets(spo_connection_data_t *connection, uint32_t ack)
-{
-    uint32_t bytes_sent;
+/* timers */
 
-    /* check if acknowledged packets are in the send buffer */
-    if (SPO_WRAPPED_LESS(ack, connection->snd_start_seq))
-        return 0;
-    if (SPO_WRAPPED_LESS(connection->snd_next_seq, ack))
-        return 0;
+SPO_INLINE spo_bool_t spo_internal_add_timer(spo_host_data_t *host, spo_connection_data_t *connection)
+{
+    uint32_t slot = host->timers.count;
 
-    bytes_sent = ack - connection->snd_start_seq;
-    if (bytes_sent > 0)
-    {
-        /* at least one more byte has acknowledged, so shift send buffer */
-        memmove(connection->snd_buf, connection->snd_buf + bytes_sent, connection->snd_buf_bytes - bytes_sent);
-        connection->snd_buf_bytes -= bytes_sent;
-        connection->snd_start_seq = ack;
+    if (slot == host->timers.size)
+        return SPO_FALSE;
 
-        SPO_LOG("received ACK %u (accepted %u bytes)", ack, bytes_sent);
-        return bytes_sent;
-    }
+    host->timers.deadlines[slot] = 0; /* process the connection as soon as possible */
+    host->timers.connections[slot] = connection;
+    connection->timer_slot = slot;
 
-    return 0;
+    ++host->timers.count;
+    return SPO_TRUE;
 }
 
-SPO_INLINE void spo_internal_process_started_connection_packet(spo_connection_data_t *connection,
-    spo_packet_type_t packet_type, uint16_t src_port, uint32_t seq, uint32_t ack)
+SPO_INLINE void spo_internal_remove_timer(spo_host_data_t *host, spo_connection_data_t *connection)
 {
-    if (ack != connection->snd_start_seq)
-        return;
+    uint32_t slot = connection->timer_slot;
+    uint32_t last_slot;
 
-    if (packet_type == SPO_PACKET_RESET)
-    {
-        /* it's enough to check ACK value */
-        spo_internal_terminate_connection(connection);
+    if (slot == SPO_NO_TIMER_SLOT)
         return;
-    }
 
-    if (spo_internal_allocate_connection_buffers(connection) == SPO_FALSE)
+    /* keep timers dense by moving the last one to the released slot */
+    last_slot = --host->timers.count;
+    if (slot != last_slot)
     {
-        spo_internal_terminate_connection(connection);
-        return;
+        host->timers.deadlines[slot] = host->timers.deadlines[last_slot];
+        host->timers.connections[slot] = host->timers.connections[last_slot];
+        host->timers.connections[slot]->timer_slot = slot;
     }
 
-    /* remove connection from 'started_connections' list */
-    spo_list_remove_items_by_data(&connection->host->started_connections, connection);
-
-    connection->state = SPO_CONNECTION_STATE_CONNECTED;
-    connection->remote_port = src_port;
-    connection->rcv_start_seq = seq;
-    connection->rcv_last_packet_time = spo_time_current();
-
-    spo_internal_handle_connection_init(connection);
-    spo_internal_fire_connected_event(connection);
+    connection->timer_slot = SPO_NO_TIMER_SLOT;
 }
 
-SPO_INLINE void spo_internal_process_rendezvous_connection_packet(spo_connection_data_t *connection, uint16_t src_port, uint32_t seq)
+/* connection has new work, so it must be processed on the next step */
+SPO_INLINE void spo_internal_wake_connection(spo_connection_data_t *connection)
 {
-    SPO_LOG("CONNECT received while in STARTED state");
-
-    /* remove connection from 'started_connections' list */
-    spo_list_remove_items_by_data(&connection->host->started_connections, connection);
-
-    connection->state = SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED;
-    connection->remote_port = src_port;
-    connection->rcv_start_seq = seq;
-    connection->rcv_last_packet_time = spo_time_current();
-
-    /* init the connection after confirming packet */
+    if (connection->timer_slot != SPO_NO_TIMER_SLOT)
+        connection->host->timers.deadlines[connection->timer_slot] = 0;
 }
 
-SPO_INLINE void spo_internal_process_incoming_connection_initial_packet(spo_host_data_t *host,
-    const spo_net_address_t *src_address, uint16_t src_port, uint32_t seq)
+/* last time the connection sent or received new data */
+SPO_INLINE spo_time_t spo_internal_get_last_data_time(spo_connection_data_t *connection)
 {
-    spo_connection_data_t *connection = spo_internal_allocate_connection(host);
-    if (connection == NULL)
-        return;
+    return SPO_MAX(connection->snd_last_data_sent_time, connection->rcv_last_data_time);
+}
 
-    /* add connection to 'incoming_connections' list */
-    if (spo_list_add_item(&host->incoming_connections, connection) == NULL)
-    {
-        spo_internal_terminate_connection(connection);
-        return;
-    }
+/* only a connection without any data in flight can hibernate */
+SPO_INLINE spo_bool_t spo_internal_can_hibernate(spo_connection_data_t *connection)
+{
+    if (connection->parameters.hibernation_timeout == 0 || SPO_CONNECTION_HIBERNATING(connection))
+        return SPO_FALSE;
 
-    SPO_LOG("CONNECT received");
+    if (connection->snd_buf_bytes > 0 || connection->rcv_bytes_ready > 0 || connection->snd_mandatory_packets > 0)
+        return SPO_FALSE;
+    if (spo_internal_has_out_of_order_data(connection) || connection->snd_acked_packets.length > 0)
+        return SPO_FALSE;
 
-    connection->state = SPO_CONNECTION_STATE_CONNECT_RECEIVED;
-    connection->remote_address = *src_address;
-    connection->remote_port = src_port;
-    connection->rcv_start_seq = seq;
-    connection->rcv_last_packet_time = spo_time_current();
+    return SPO_TRUE;
 }
 
-SPO_INLINE void spo_internal_process_incoming_connection_confirming_packet(spo_connection_data_t *connection,
-    spo_packet_type_t packet_type, uint16_t src_port, uint32_t seq, uint32_t ack, const uint8_t *data, uint32_t data_size)
+/* the nearest time when an idle connection has to be processed */
+SPO_INLINE spo_time_t spo_internal_get_connection_deadline(spo_connection_data_t *connection)
 {
-    if (src_port != connection->remote_port)
-        return;
-    if (ack != connection->snd_start_seq)
-        return;
+    spo_time_t deadline;
+    spo_configuration *configuration = &connection->host->configuration;
 
-    if (packet_type == SPO_PACKET_RESET)
+    switch (connection->state)
     {
-        /* it's enough to check ACK value */
-        spo_internal_terminate_connection(connection);
-        return;
-    }
+    case SPO_CONNECTION_STATE_CONNECT_STARTED:
+        return connection->cold.connect_time;
+    case SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED:
+    case SPO_CONNECTION_STATE_CONNECT_RECEIVED:
+        return connection->snd_last_packet_time + SPO_TIME_FROM_MSECS(configuration->accept_retransmission_timeout);
+    case SPO_CONNECTION_STATE_CONNECTED:
+        if (connection->snd_mandatory_packets > 0) /* the ACK couldn't be sent yet */
+            return connection->host->time;
 
-    if (spo_internal_allocate_connection_buffers(connection) == SPO_FALSE)
-    {
-        spo_internal_terminate_connection(connection);
-        return;
-    }
+        deadline = SPO_MIN(connection->rcv_last_packet_time + SPO_TIME_FROM_MSECS(connection->parameters.connection_timeout),
+            connection->snd_last_packet_time + SPO_TIME_FROM_MSECS(connection->parameters.ping_interval));
 
-    if (data_size > 0)
-    {
-        if (spo_internal_fill_rcv_buffer(connection, seq, data, data_size) == SPO_FALSE)
-            return;
-        spo_internal_handle_new_data_received(connection);
-    }
-    else
-    {
-        if (seq != connection->rcv_start_seq)
-            return;
+        if (connection->snd_buf_bytes > 0) /* retransmission timer is running */
+        {
+            deadline = SPO_MIN(deadline, connection->snd_last_data_sent_time +
+                SPO_TIME_FROM_MSECS(connection->parameters.data_retransmission_timeout));
+        }
+        if (spo_internal_can_hibernate(connection))
+        {
+            deadline = SPO_MIN(deadline, spo_internal_get_last_data_time(connection) +
+                SPO_TIME_FROM_MSECS(connection->parameters.hibernation_timeout));
+        }
+        return deadline;
+    default: /* no timers run before the connect and after the close */
+        break;
     }
 
-    connection->rcv_last_packet_time = spo_time_current();
+    return 0;
+}
 
-    spo_internal_handle_connection_init(connection);
+/* connections management */
 
-    if (connection->state == SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED)
+SPO_INLINE void spo_internal_detach_connection(spo_connection_data_t *connection)
+{
+    /* remove connection from 'connections' list and from the timers */
+    if (connection->cold.list_item != NULL)
     {
-        connection->state = SPO_CONNECTION_STATE_CONNECTED;
-        spo_internal_fire_connected_event(connection);
+        spo_list_remove_item(&connection->host->connections, connection->cold.list_item);
+        connection->cold.list_item = NULL;
     }
-    else
-    {
-        /* remove connection from 'incoming_connections' list */
-        spo_list_remove_items_by_data(&connection->host->incoming_connections, connection);
 
-        connection->state = SPO_CONNECTION_STATE_CONNECTED;
-        spo_internal_fire_incoming_connection_event(connection);
-    }
+    spo_internal_remove_timer(connection->host, connection);
 }
 
-SPO_INLINE void spo_internal_process_incoming_connection_packet(spo_host_data_t *host,
-    const spo_net_address_t *src_address, uint16_t src_port, uint32_t seq)
+SPO_INLINE uint16_t spo_internal_get_port_from_pool(spo_host_data_t *host)
 {
-    spo_connection_data_t *connection = spo_internal_find_active_connection(host, src_address, src_port);
-    if (connection != NULL)
+    uint16_t port;
+    uint16_t ports_available[UINT16_MAX];
+    uint16_t ports_count = 0;
+
+    /* find available ports, first and last ports are reserved */
+    for (port = 1; port < UINT16_MAX; ++port)
     {
-        /* looks like duplicate CONNECT, so update receive time and ignore the packet */
-        connection->rcv_last_packet_time = spo_time_current();
-        SPO_LOG("duplicate CONNECT received");
-        return;
+        if (host->connections_by_ports[port] == NULL)
+            ports_available[ports_count++] = port;
     }
+    if (ports_count == 0)
+        return 0;
 
-    connection = spo_internal_find_started_connection(host, src_address);
-    if (connection != NULL)
-        spo_internal_process_rendezvous_connection_packet(connection, src_port, seq);
-    else
-        spo_internal_process_incoming_connection_initial_packet(host, src_address, src_port, seq);
+    return ports_available[spo_random_next() % ports_count];
 }
 
-SPO_INLINE void spo_internal_process_acks_list(spo_connection_data_t *connection, const spo_packet_desc_t *acks_list, unsigned acks_count)
+/* releases the acknowledged user buffers or all of them, returns SPO_TRUE if some buffer is released */
+SPO_INLINE spo_bool_t spo_internal_release_user_buffers(spo_connection_data_t *connection, spo_bool_t delivered)
 {
-    spo_packet_desc_t packet_desc;
-    uint32_t start_seq;
-    uint32_t size;
-    unsigned ack = 0;
+    spo_send_buffer_t buffer;
+    spo_send_buffer_t *current;
+    spo_bool_t released = SPO_FALSE;
 
-    while (ack < acks_count)
+    while ((current = connection->snd_user_buffers) != NULL)
     {
-        start_seq = acks_list[ack].start;
-        size = acks_list[ack].size;
-
-        /* check if the data are in send buffer */
-        if (SPO_WRAPPED_GREATER_EQ(start_seq, connection->snd_start_seq) &&
-            SPO_WRAPPED_LESS_EQ(start_seq + size, connection->snd_next_seq))
-        {
-            /* save description of the new data */
-            packet_desc.start = start_seq;
-            packet_desc.size = size;
+        if (delivered && SPO_WRAPPED_GREATER(current->start_seq + current->size, connection->snd_start_seq))
+            break;
 
-            if (spo_internal_merge_packet_desc(&connection->snd_acked_packets, &packet_desc) == SPO_FALSE)
-                break;
-        }
+        /* unlink the buffer before the event, so the user code can send the next one from it */
+        connection->snd_user_buffers = current->next_buffer;
+        if (connection->snd_user_buffers == NULL)
+            connection->snd_last_user_buffer = NULL;
+        buffer = *current;
+        spo_slab_free(&connection->host->send_buffers_slab, current);
 
-        ++ack;
+        spo_internal_fire_send_completion_event(connection, &buffer, delivered);
+        released = SPO_TRUE;
     }
+
+    return released;
 }
 
-SPO_INLINE void spo_internal_remove_old_acks(spo_connection_data_t *connection, uint32_t ack)
+SPO_INLINE void spo_internal_release_posted_buffers(spo_connection_data_t *connection)
 {
-    spo_packet_desc_t *packet_desc;
-    spo_index_item_t *current = SPO_INDEX_FIRST(&connection->snd_acked_packets);
+    spo_receive_buffer_t buffer;
+    spo_receive_buffer_t *current;
 
-    while (SPO_INDEX_VALID(&connection->snd_acked_packets, current))
+    while ((current = connection->rcv_posted_buffers) != NULL)
     {
-        packet_desc = (spo_packet_desc_t *)current->data;
-
-        if (SPO_WRAPPED_LESS_EQ(ack, packet_desc->start)) /* packet from the future */
-            break;
+        connection->rcv_posted_buffers = current->next_buffer;
+        if (connection->rcv_posted_buffers == NULL)
+            connection->rcv_last_posted_buffer = NULL;
+        buffer = *current;
+        spo_slab_free(&connection->host->receive_buffers_slab, current);
 
-        if (SPO_WRAPPED_LESS(ack, packet_desc->start + packet_desc->size))
-        {
-            /* the data are not fully acknowledged */
-            /* it should not happen, so something is wrong */
-            current = SPO_INDEX_NEXT(&connection->snd_acked_packets, current);
-        }
-        else
-        {
-            /* remove old packet */
-            free(packet_desc);
-            current = spo_index_remove_item(&connection->snd_acked_packets, current);
-        }
+        spo_internal_fire_receive_completion_event(connection, &buffer, SPO_FALSE);
     }
 }
 
-SPO_INLINE void spo_internal_process_established_connection_packet(spo_connection_data_t *connection,
-    spo_packet_type_t packet_type, uint16_t src_port, uint32_t seq, uint32_t ack,
-    const spo_packet_desc_t *acks_list, unsigned acks_count,
-    const uint8_t *data, uint32_t data_size)
+SPO_INLINE void spo_internal_destroy_connection(spo_connection_data_t *connection)
 {
-    if (src_port != connection->remote_port)
-        return;
-    if (spo_internal_check_ack(connection, ack) == SPO_FALSE)
-        return;
+    /* the user memory isn't referenced after the connection is closed */
+    spo_internal_release_user_buffers(connection, SPO_FALSE);
+    spo_internal_release_posted_buffers(connection);
 
-    connection->rcv_last_packet_time = spo_time_current();
+    /* release port */
+    connection->host->connections_by_ports[connection->local_port] = NULL;
 
-    if (packet_type == SPO_PACKET_RESET)
-    {
-        if (seq == connection->rcv_start_seq)
-        {
-            /* RESET is valid */
-            spo_internal_terminate_connection(connection);
-        }
-        else if (spo_internal_check_seq(connection, seq))
-        {
-            /* send ACK, so other side can confirm the RESET */
-            if (connection->snd_mandatory_packets == 0)
-                connection->snd_mandatory_packets = 1;
-        }
-        return;
-    }
+    /* destroy buffers */
+    spo_index_destroy(&connection->rcv_packets);
+    spo_bitmap_destroy(&connection->rcv_bitmap);
+    spo_index_destroy(&connection->snd_acked_packets);
+    spo_index_destroy(&connection->snd_lost_ranges);
 
-    /* sender */
-    if (connection->snd_buf_bytes > 0)
+    spo_segment_chain_destroy(&connection->rcv_buf, &connection->host->segments_pool);
+    spo_segment_chain_destroy(&connection->snd_buf, &connection->host->segments_pool);
+}
+
+SPO_INLINE void spo_internal_leave_started_state(spo_connection_data_t *connection)
+{
+    /* remove connection from 'started_connections' list */
+    spo_list_remove_items_by_data(&connection->host->started_connections, connection);
+
+    if (connection->cold.connect_attempts > 0)
+        --connection->host->connects_in_flight;
+}
+
+SPO_INLINE void spo_internal_terminate_connection(spo_connection_data_t *connection)
+{
+    spo_connection_state_t state = connection->state;
+
+    /* first, mark connection as closed */
+    connection->state = SPO_CONNECTION_STATE_CLOSED;
+    spo_internal_detach_connection(connection);
+
+    if (connection->cold.pool != NULL)
+    {
+        if (state == SPO_CONNECTION_STATE_CONNECT_STARTED)
+            spo_internal_leave_started_state(connection);
+
+        /* the pool will start another connection */
+        spo_list_remove_items_by_data(&connection->cold.pool->connections, connection);
+
+        spo_internal_destroy_connection(connection);
+        /* we must entirely destroy such connections because the user code doesn't know about them */
+        spo_slab_free(&connection->host->connections_slab, connection);
+        return;
+    }
+
+    switch (state)
+    {
+    case SPO_CONNECTION_STATE_CONNECT_STARTED:
+        spo_internal_leave_started_state(connection);
+
+        /* fall through */
+    case SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED:
+        /* it was a started connection, so notify the user code */
+        spo_internal_fire_unable_to_connect_event(connection);
+        spo_internal_destroy_connection(connection);
+        break;
+    case SPO_CONNECTION_STATE_CONNECT_RECEIVED:
+        /* remove connection from 'incoming_connections' list */
+        spo_list_remove_items_by_data(&connection->host->incoming_connections, connection);
+
+        spo_internal_destroy_connection(connection);
+        /* we must entirely destroy such connections because the user code doesn't know about them */
+        spo_slab_free(&connection->host->connections_slab, connection);
+        break;
+    case SPO_CONNECTION_STATE_CONNECTED:
+        spo_internal_fire_connection_lost_event(connection);
+        spo_internal_destroy_connection(connection);
+        break;
+    case SPO_CONNECTION_STATE_INIT:
+        spo_internal_destroy_connection(connection);
+        /* we must entirely destroy such connections because the user code doesn't know about them */
+        spo_slab_free(&connection->host->connections_slab, connection);
+        break;
+    }
+}
+
+SPO_INLINE void spo_internal_init_connection_parameters(spo_connection_parameters_t *parameters,
+    const spo_configuration *configuration)
+{
+    parameters->buf_size = configuration->connection_buf_size;
+    parameters->initial_cwnd_bytes = configuration->initial_cwnd_in_packets * SPO_MAX_PAYLOAD_SIZE;
+    parameters->cwnd_on_timeout_bytes = configuration->cwnd_on_timeout_in_packets * SPO_MAX_PAYLOAD_SIZE;
+    parameters->min_ssthresh_bytes = configuration->min_ssthresh_in_packets * SPO_MAX_PAYLOAD_SIZE;
+    parameters->max_cwnd_inc_on_slowstart_bytes = configuration->max_cwnd_inc_on_slowstart_in_packets * SPO_MAX_PAYLOAD_SIZE;
+    parameters->duplicate_acks_for_retransmit = configuration->duplicate_acks_for_retransmit;
+    parameters->ssthresh_factor_on_timeout_percent = configuration->ssthresh_factor_on_timeout_percent;
+    parameters->ssthresh_factor_on_loss_percent = configuration->ssthresh_factor_on_loss_percent;
+    parameters->skip_packets_before_acknowledgement = configuration->skip_packets_before_acknowledgement;
+    parameters->max_consecutive_acknowledges = configuration->max_consecutive_acknowledges;
+    parameters->data_retransmission_timeout = configuration->data_retransmission_timeout;
+    parameters->connection_timeout = configuration->connection_timeout;
+    parameters->ping_interval = configuration->ping_interval;
+    parameters->hibernation_timeout = configuration->hibernation_timeout;
+    parameters->receive_bitmap = configuration->receive_bitmap;
+}
+
+SPO_INLINE void spo_internal_init_connection(spo_connection_data_t *connection, spo_host_data_t *host, uint16_t port)
+{
+    memset(connection, 0, sizeof(spo_connection_data_t));
+    connection->host = host;
+    connection->state = SPO_CONNECTION_STATE_INIT;
+    connection->cold.created_time = host->time;
+    connection->local_port = port;
+    connection->timer_slot = SPO_NO_TIMER_SLOT;
+    connection->snd_start_seq = spo_random_next();
+    connection->snd_next_seq = connection->snd_start_seq;
+    spo_index_init(&connection->rcv_packets, &host->memory);
+    spo_index_init(&connection->snd_acked_packets, &host->memory);
+    spo_index_init(&connection->snd_lost_ranges, &host->memory);
+    connection->snd_lost_ranges_valid = SPO_TRUE;
+    spo_segment_chain_init(&connection->rcv_buf);
+    spo_segment_chain_init(&connection->snd_buf);
+    connection->snd_user_buffers = NULL;
+    connection->snd_last_user_buffer = NULL;
+    connection->rcv_posted_buffers = NULL;
+    connection->rcv_last_posted_buffer = NULL;
+    spo_internal_init_connection_parameters(&connection->parameters, &host->configuration);
+    spo_bitmap_init(&connection->rcv_bitmap, &host->memory, connection->parameters.buf_size);
+
+    host->connections_by_ports[port] = connection;
+}
+
+SPO_INLINE spo_connection_data_t *spo_internal_reuse_oldest_connection(spo_host_data_t *host)
+{
+    spo_list_item_t *list_item;
+    uint32_t timer_slot;
+    spo_connection_data_t *connection = spo_internal_find_oldest_incoming_connection(host);
+    if (connection == NULL)
+        return NULL;
+
+    /* remove connection from 'incoming_connections' list, the caller decides where it goes now */
+    spo_list_remove_items_by_data(&host->incoming_connections, connection);
+    spo_internal_destroy_connection(connection);
+
+    /* the connection keeps its place in 'connections' list and in the timers */
+    list_item = connection->cold.list_item;
+    timer_slot = connection->timer_slot;
+
+    spo_internal_init_connection(connection, host, connection->local_port);
+
+    connection->cold.list_item = list_item;
+    connection->timer_slot = timer_slot;
+    spo_internal_wake_connection(connection);
+    return connection;
+}
+
+SPO_INLINE spo_connection_data_t *spo_internal_create_connection(spo_host_data_t *host, uint16_t port)
+{
+    spo_connection_data_t *connection = (spo_connection_data_t *)spo_slab_alloc(&host->connections_slab);
+    if (connection == NULL)
+        return NULL;
+
+    spo_internal_init_connection(connection, host, port);
+
+    connection->cold.list_item = spo_list_add_item(&host->connections, connection);
+    if (connection->cold.list_item == NULL || spo_internal_add_timer(host, connection) == SPO_FALSE)
+    {
+        spo_internal_detach_connection(connection);
+        spo_internal_destroy_connection(connection);
+        spo_slab_free(&host->connections_slab, connection);
+        return NULL;
+    }
+
+    return connection;
+}
+
+SPO_INLINE spo_connection_data_t *spo_internal_allocate_connection(spo_host_data_t *host)
+{
+    uint16_t port;
+
+    if (host->connections.length >= host->configuration.max_connections)
+    {
+        /* try to reuse the oldest connection */
+        return spo_internal_reuse_oldest_connection(host);
+    }
+
+    port = spo_internal_get_port_from_pool(host);
+    if (port == 0) /* all ports are busy */
+    {
+        /* try to reuse the oldest connection */
+        return spo_internal_reuse_oldest_connection(host);
+    }
+
+    return spo_internal_create_connection(host, port);
+}
+
+/* overload protection */
+
+SPO_INLINE void spo_internal_init_token_bucket(spo_host_data_t *host, spo_token_bucket_t *bucket, uint32_t rate)
+{
+    bucket->tokens = (uint64_t)rate * SPO_TOKEN_SIZE;
+    bucket->update_time = host->time;
+}
+
+SPO_INLINE spo_bool_t spo_internal_take_token(spo_host_data_t *host, spo_token_bucket_t *bucket, uint32_t rate)
+{
+    uint64_t max_tokens = (uint64_t)rate * SPO_TOKEN_SIZE;
+
+    if (rate == 0) /* no limit */
+        return SPO_TRUE;
+
+    /* each elapsed microsecond adds 'rate' units */
+    bucket->tokens += (host->time - bucket->update_time) * rate;
+    if (bucket->tokens > max_tokens)
+        bucket->tokens = max_tokens;
+    bucket->update_time = host->time;
+
+    if (bucket->tokens < SPO_TOKEN_SIZE)
+        return SPO_FALSE;
+
+    bucket->tokens -= SPO_TOKEN_SIZE;
+    return SPO_TRUE;
+}
+
+SPO_INLINE spo_source_limits_t *spo_internal_get_source_limits(spo_host_data_t *host, const spo_net_address_t *address)
+{
+    spo_source_limits_t *limits;
+    uint64_t source;
+    uint32_t address_size = (address->type == SPO_NET_SOCKET_TYPE_IPV4) ? SPO_NET_IPV4_ADDRESS_SIZE : SPO_NET_IPV6_ADDRESS_SIZE;
+
+    if (host->source_limits == NULL)
+        return NULL;
+
+    /* keyed hash doesn't allow to choose addresses which evict each other */
+    source = spo_siphash(host->secret_key, address->address, address_size) | 1;
+    limits = host->source_limits + source % SPO_SOURCE_LIMITS_SIZE;
+
+    if (limits->source != source)
+    {
+        /* the other source is forgotten, new one starts with the full buckets */
+        limits->source = source;
+        spo_internal_init_token_bucket(host, &limits->resets, host->configuration.max_resets_per_source);
+        spo_internal_init_token_bucket(host, &limits->connects, host->configuration.max_connects_per_source);
+    }
+
+    return limits;
+}
+
+SPO_INLINE spo_bool_t spo_internal_allow_reset(spo_host_data_t *host, const spo_net_address_t *address)
+{
+    spo_source_limits_t *limits = spo_internal_get_source_limits(host, address);
+
+    /* check the source first, so the single source doesn't spend the global tokens */
+    if ((limits == NULL || spo_internal_take_token(host, &limits->resets, host->configuration.max_resets_per_source)) &&
+        spo_internal_take_token(host, &host->resets_limit, host->configuration.max_resets_per_second))
+        return SPO_TRUE;
+
+    ++host->statistics.resets_dropped;
+    return SPO_FALSE;
+}
+
+SPO_INLINE spo_bool_t spo_internal_allow_connect(spo_host_data_t *host, const spo_net_address_t *address)
+{
+    spo_source_limits_t *limits = spo_internal_get_source_limits(host, address);
+
+    if (limits == NULL || spo_internal_take_token(host, &limits->connects, host->configuration.max_connects_per_source))
+        return SPO_TRUE;
+
+    ++host->statistics.connects_dropped;
+    return SPO_FALSE;
+}
+
+/* first CONNECTs wait for a free handshake slot, and all CONNECTs wait for the pacer,
+   held connection is scheduled to the time when it can try again */
+SPO_INLINE spo_bool_t spo_internal_allow_connect_packet(spo_connection_data_t *connection)
+{
+    spo_host_data_t *host = connection->host;
+    uint32_t max_connects_in_flight = host->configuration.max_connects_in_flight;
+    uint32_t max_connects_per_second = host->configuration.max_connects_per_second;
+
+    if (connection->cold.connect_attempts == 0 && max_connects_in_flight > 0 &&
+        host->connects_in_flight >= max_connects_in_flight)
+    {
+        connection->cold.connect_time = host->time + SPO_CONNECT_PACING_DELAY;
+        return SPO_FALSE;
+    }
+
+    if (max_connects_per_second > 0)
+    {
+        if (host->connect_pacer_time > host->time)
+        {
+            connection->cold.connect_time = host->connect_pacer_time;
+            return SPO_FALSE;
+        }
+
+        if (host->connect_pacer_time + SPO_CONNECT_PACING_DELAY < host->time)
+            host->connect_pacer_time = host->time - SPO_CONNECT_PACING_DELAY;
+        host->connect_pacer_time += SPO_TIME_FROM_MSECS(1000) / max_connects_per_second;
+    }
+
+    return SPO_TRUE;
+}
+
+/* network packets processing */
+
+SPO_INLINE spo_bool_t spo_internal_check_seq(spo_connection_data_t *connection, uint32_t seq)
+{
+    /* check if SEQ is in the valid range */
+    /* we should check previous SEQ numbers as the other side could send old SEQ before the new ACK is received */
+    uint32_t min_seq = connection->rcv_start_seq - connection->parameters.buf_size;
+    uint32_t max_seq = connection->rcv_start_seq + connection->parameters.buf_size - 1;
+
+    if (SPO_WRAPPED_LESS(seq, min_seq))
+        return SPO_FALSE;
+    if (SPO_WRAPPED_LESS(max_seq, seq))
+        return SPO_FALSE;
+
+    return SPO_TRUE;
+}
+
+SPO_INLINE spo_bool_t spo_internal_check_ack(spo_connection_data_t *connection, uint32_t ack)
+{
+    /* check if ACK is in the valid range */
+    /* we should check previous SEQ numbers to correctly process out-of-order packets */
+    uint32_t min_ack = connection->snd_start_seq - connection->parameters.buf_size;
+    uint32_t max_ack = connection->snd_next_seq;
+
+    if (SPO_WRAPPED_LESS(ack, min_ack))
+        return SPO_FALSE;
+    if (SPO_WRAPPED_LESS(max_ack, ack))
+        return SPO_FALSE;
+
+    return SPO_TRUE;
+}
+
+/* ranges of the posted buffers are read from them, the rest of the data from the segments */
+SPO_INLINE void spo_internal_read_rcv_buffer(spo_connection_data_t *connection, uint32_t pos, uint8_t *data, uint32_t size)
+{
+    uint32_t bytes_to_read;
+    uint32_t seq = connection->rcv_start_seq + pos;
+    spo_receive_buffer_t *buffer = connection->rcv_posted_buffers;
+
+    while (size > 0)
+    {
+        while (buffer != NULL && SPO_WRAPPED_LESS_EQ(buffer->start_seq + buffer->size, seq))
+            buffer = buffer->next_buffer;
+
+        if (buffer != NULL && SPO_WRAPPED_LESS_EQ(buffer->start_seq, seq))
+        {
+            bytes_to_read = SPO_MIN(size, buffer->start_seq + buffer->size - seq);
+            memcpy(data, buffer->data + (seq - buffer->start_seq), bytes_to_read);
+        }
+        else
+        {
+            bytes_to_read = (buffer != NULL) ? SPO_MIN(size, buffer->start_seq - seq) : size;
+            spo_segment_chain_read(&connection->rcv_buf, seq - connection->rcv_start_seq, data, bytes_to_read);
+        }
+
+        data += bytes_to_read;
+        seq += bytes_to_read;
+        size -= bytes_to_read;
+    }
+}
+
+/* data of the posted buffers are placed directly into them, the rest into the segments,
+   returns count of the bytes written before the buffers memory limit is reached */
+SPO_INLINE uint32_t spo_internal_write_rcv_buffer(spo_connection_data_t *connection,
+    uint32_t seq, const uint8_t *data, uint32_t size, spo_bool_t use_reserve)
+{
+    uint32_t bytes_to_write;
+    uint32_t bytes_written;
+    uint32_t total_bytes_written = 0;
+    spo_receive_buffer_t *buffer = connection->rcv_posted_buffers;
+
+    while (total_bytes_written < size)
+    {
+        while (buffer != NULL && SPO_WRAPPED_LESS_EQ(buffer->start_seq + buffer->size, seq))
+            buffer = buffer->next_buffer;
+
+        if (buffer != NULL && SPO_WRAPPED_LESS_EQ(buffer->start_seq, seq))
+        {
+            bytes_to_write = SPO_MIN(size - total_bytes_written, buffer->start_seq + buffer->size - seq);
+            memcpy(buffer->data + (seq - buffer->start_seq), data + total_bytes_written, bytes_to_write);
+            bytes_written = bytes_to_write;
+        }
+        else
+        {
+            bytes_to_write = size - total_bytes_written;
+            if (buffer != NULL)
+                bytes_to_write = SPO_MIN(bytes_to_write, buffer->start_seq - seq);
+
+            bytes_written = spo_segment_chain_write(&connection->rcv_buf, &connection->host->segments_pool,
+                seq - connection->rcv_start_seq, data + total_bytes_written, bytes_to_write, use_reserve);
+        }
+
+        total_bytes_written += bytes_written;
+        seq += bytes_written;
+        if (bytes_written < bytes_to_write)
+            break;
+    }
+
+    return total_bytes_written;
+}
+
+SPO_INLINE spo_bool_t spo_internal_fill_rcv_buffer(spo_connection_data_t *connection, uint32_t seq, const uint8_t *data, uint32_t data_size)
+{
+    uint32_t common_start_seq;
+    uint32_t common_end_seq;
+    uint32_t common_data_size;
+
+    uint32_t win_start_seq = connection->rcv_start_seq + connection->rcv_bytes_ready;
+    uint32_t win_end_seq = connection->rcv_start_seq + connection->parameters.buf_size;
+
+    uint32_t data_start_seq = seq;
+    uint32_t data_end_seq = data_start_seq + data_size;
+
+    /* check if the receive buffer can accept received packets */
+    if (SPO_WRAPPED_LESS_EQ(data_end_seq, win_start_seq))
+    {
+        connection->host->statistics.duplicate_bytes_received += data_size;
+        return SPO_FALSE;
+    }
+    if (SPO_WRAPPED_LESS_EQ(win_end_seq, data_start_seq))
+        return SPO_FALSE;
+
+    if (SPO_WRAPPED_LESS(data_start_seq, win_start_seq))
+        connection->host->statistics.duplicate_bytes_received += win_start_seq - data_start_seq;
+
+    /* unsigned arithmetic does all the magic */
+    common_start_seq = SPO_WRAPPED_MAX(data_start_seq, win_start_seq);
+    common_end_seq = SPO_WRAPPED_MIN(win_end_seq, data_end_seq);
+    common_data_size = common_end_seq - common_start_seq;
+
+    if (common_data_size > 0)
+    {
+        uint32_t pos_in_data;
+
+        pos_in_data = common_start_seq - data_start_seq;
+
+        if (common_start_seq != win_start_seq)
+        {
+            spo_packet_desc_t range;
+
+            /* out-of-order data may have been received already */
+            if (spo_internal_find_received_range(connection, common_start_seq, &range) &&
+                SPO_WRAPPED_LESS_EQ(common_end_seq, range.start + range.size))
+                connection->host->statistics.duplicate_bytes_received += common_data_size;
+        }
+
+        /* in-order data may use the memory reserve, so readers can always make progress,
+           the rest of the packet is dropped when the buffers memory limit is reached */
+        common_data_size = spo_internal_write_rcv_buffer(connection,
+            common_start_seq, data + pos_in_data, common_data_size, common_start_seq == win_start_seq);
+        if (common_data_size == 0)
+            return SPO_FALSE;
+
+        /* save description of the new data */
+        if (spo_internal_save_received_data(connection, common_start_seq, common_data_size) == SPO_FALSE)
+            return SPO_FALSE;
+
+        connection->rcv_last_data_seq = common_start_seq;
+        connection->rcv_last_data_time = connection->host->time;
+        return SPO_TRUE;
+    }
+
+    return SPO_FALSE;
+}
+
+SPO_INLINE uint32_t spo_internal_remove_acknowledged_packets(spo_connection_data_t *connection, uint32_t ack)
+{
+    uint32_t bytes_sent;
+
+    /* check if acknowledged packets are in the send buffer */
+    if (SPO_WRAPPED_LESS(ack, connection->snd_start_seq))
+        return 0;
+    if (SPO_WRAPPED_LESS(connection->snd_next_seq, ack))
+        return 0;
+
+    bytes_sent = ack - connection->snd_start_seq;
+    if (bytes_sent > 0)
+    {
+        /* at least one more byte has acknowledged, so release the head of the send buffer */
+        spo_segment_chain_consume(&connection->snd_buf, &connection->host->segments_pool, bytes_sent);
+        connection->snd_buf_bytes -= bytes_sent;
+        if (connection->snd_buf_bytes == 0)
+            spo_segment_chain_clear(&connection->snd_buf, &connection->host->segments_pool);
+        connection->snd_start_seq = ack;
+
+        SPO_LOG("received ACK %u (accepted %u bytes)", ack, bytes_sent);
+        return bytes_sent;
+    }
+
+    return 0;
+}
+
+SPO_INLINE void spo_internal_process_started_connection_packet(spo_connection_data_t *connection,
+    spo_packet_type_t packet_type, uint16_t src_port, uint32_t seq, uint32_t ack)
+{
+    if (ack != connection->snd_start_seq)
+        return;
+
+    if (packet_type == SPO_PACKET_RESET)
+    {
+        /* it's enough to check ACK value */
+        spo_internal_terminate_connection(connection);
+        return;
+    }
+
+    spo_internal_leave_started_state(connection);
+
+    connection->state = SPO_CONNECTION_STATE_CONNECTED;
+    connection->remote_port = src_port;
+    connection->rcv_start_seq = seq;
+    connection->rcv_last_packet_time = connection->host->time;
+
+    spo_internal_handle_connection_init(connection);
+    spo_internal_fire_connected_event(connection);
+}
+
+SPO_INLINE void spo_internal_process_rendezvous_connection_packet(spo_connection_data_t *connection, uint16_t src_port, uint32_t seq)
+{
+    SPO_LOG("CONNECT received while in STARTED state");
+
+    spo_internal_leave_started_state(connection);
+
+    connection->state = SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED;
+    connection->remote_port = src_port;
+    connection->rcv_start_seq = seq;
+    connection->rcv_last_packet_time = connection->host->time;
+    spo_internal_wake_connection(connection);
+
+    /* init the connection after confirming packet */
+}
+
+/* cookie is a keyed hash of the handshake data, it's used as the initial SEQ of the host,
+   so the other side returns it in the ACK field of the confirming packet */
+SPO_INLINE uint32_t spo_internal_make_cookie(spo_host_data_t *host, const spo_net_address_t *remote_address,
+    uint16_t remote_port, uint16_t local_port, uint32_t remote_seq, uint64_t interval)
+{
+    uint8_t data[sizeof(spo_net_socket_type_t) + SPO_NET_IPV6_ADDRESS_SIZE + 3 * sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint64_t)];
+    uint32_t address_size = (remote_address->type == SPO_NET_SOCKET_TYPE_IPV4) ? SPO_NET_IPV4_ADDRESS_SIZE : SPO_NET_IPV6_ADDRESS_SIZE;
+    uint32_t data_size = 0;
+
+    memcpy(data + data_size, &remote_address->type, sizeof(spo_net_socket_type_t));
+    data_size += sizeof(spo_net_socket_type_t);
+    memcpy(data + data_size, remote_address->address, address_size);
+    data_size += address_size;
+    memcpy(data + data_size, &remote_address->port, sizeof(uint16_t));
+    data_size += sizeof(uint16_t);
+    memcpy(data + data_size, &remote_port, sizeof(uint16_t));
+    data_size += sizeof(uint16_t);
+    memcpy(data + data_size, &local_port, sizeof(uint16_t));
+    data_size += sizeof(uint16_t);
+    memcpy(data + data_size, &remote_seq, sizeof(uint32_t));
+    data_size += sizeof(uint32_t);
+    memcpy(data + data_size, &interval, sizeof(uint64_t));
+    data_size += sizeof(uint64_t);
+
+    return (uint32_t)spo_siphash(host->secret_key, data, data_size);
+}
+
+SPO_INLINE uint64_t spo_internal_get_cookie_interval(spo_host_data_t *host)
+{
+    return host->time / SPO_TIME_FROM_MSECS(SPO_COOKIE_INTERVAL);
+}
+
+SPO_INLINE spo_bool_t spo_internal_cookies_engaged(spo_host_data_t *host)
+{
+    return host->configuration.connect_cookies_threshold > 0 &&
+        host->incoming_connections.length >= host->configuration.connect_cookies_threshold;
+}
+
+/* confirming packets of the cookie handshakes may still arrive */
+SPO_INLINE spo_bool_t spo_internal_cookies_pending(spo_host_data_t *host)
+{
+    return host->cookie_sent_time != 0 &&
+        spo_internal_time_elapsed(host, host->cookie_sent_time, 2 * SPO_COOKIE_INTERVAL) == SPO_FALSE;
+}
+
+SPO_INLINE uint16_t spo_internal_get_random_free_port(spo_host_data_t *host)
+{
+    uint16_t port;
+    int attempts;
+
+    /* the full scan of the ports is too expensive while CONNECTs are flooding */
+    for (attempts = 0; attempts < SPO_COOKIE_PORT_ATTEMPTS; ++attempts)
+    {
+        port = (uint16_t)(1 + spo_random_next() % (UINT16_MAX - 1));
+        if (host->connections_by_ports[port] == NULL)
+            return port;
+    }
+
+    return 0;
+}
+
+SPO_INLINE void spo_internal_send_cookie(spo_host_data_t *host,
+    const spo_net_address_t *src_address, uint16_t src_port, uint32_t seq)
+{
+    uint32_t cookie;
+    uint16_t port = spo_internal_get_random_free_port(host);
+    if (port == 0)
+        return;
+
+    /* nothing is allocated, the connection is created when the cookie comes back */
+    cookie = spo_internal_make_cookie(host, src_address, src_port, port, seq, spo_internal_get_cookie_interval(host));
+
+    if (spo_internal_send_stateless_packet(host, SPO_PACKET_ACCEPT, src_address, port, src_port, cookie, seq))
+    {
+        host->cookie_sent_time = host->time;
+        ++host->statistics.connect_cookies_sent;
+
+        SPO_LOG("CONNECT received, cookie sent");
+    }
+}
+
+SPO_INLINE void spo_internal_process_incoming_connection_initial_packet(spo_host_data_t *host,
+    const spo_net_address_t *src_address, uint16_t src_port, uint32_t seq)
+{
+    spo_connection_data_t *connection;
+
+    if (spo_internal_cookies_engaged(host))
+    {
+        /* too many half-open connections, so don't create another one */
+        spo_internal_send_cookie(host, src_address, src_port, seq);
+        return;
+    }
+
+    connection = spo_internal_allocate_connection(host);
+    if (connection == NULL)
+        return;
+
+    /* add connection to 'incoming_connections' list */
+    if (spo_list_add_item(&host->incoming_connections, connection) == NULL)
+    {
+        spo_internal_terminate_connection(connection);
+        return;
+    }
+
+    SPO_LOG("CONNECT received");
+
+    connection->state = SPO_CONNECTION_STATE_CONNECT_RECEIVED;
+    connection->remote_address = *src_address;
+    connection->remote_port = src_port;
+    connection->rcv_start_seq = seq;
+    connection->rcv_last_packet_time = connection->host->time;
+}
+
+SPO_INLINE void spo_internal_process_incoming_connection_confirming_packet(spo_connection_data_t *connection,
+    spo_packet_type_t packet_type, uint16_t src_port, uint32_t seq, uint32_t ack, const uint8_t *data, uint32_t data_size)
+{
+    if (src_port != connection->remote_port)
+        return;
+    if (ack != connection->snd_start_seq)
+        return;
+
+    if (packet_type == SPO_PACKET_RESET)
+    {
+        /* it's enough to check ACK value */
+        spo_internal_terminate_connection(connection);
+        return;
+    }
+
+    if (data_size > 0)
+    {
+        if (spo_internal_fill_rcv_buffer(connection, seq, data, data_size) == SPO_FALSE)
+            return;
+        spo_internal_handle_new_data_received(connection);
+    }
+    else
+    {
+        if (seq != connection->rcv_start_seq)
+            return;
+    }
+
+    connection->rcv_last_packet_time = connection->host->time;
+
+    spo_internal_handle_connection_init(connection);
+
+    if (connection->state == SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED)
+    {
+        connection->state = SPO_CONNECTION_STATE_CONNECTED;
+        spo_internal_fire_connected_event(connection);
+    }
+    else
+    {
+        /* remove connection from 'incoming_connections' list */
+        spo_list_remove_items_by_data(&connection->host->incoming_connections, connection);
+
+        connection->state = SPO_CONNECTION_STATE_CONNECTED;
+        spo_internal_fire_incoming_connection_event(connection);
+    }
+}
+
+/* returns SPO_TRUE if the packet completes a cookie handshake */
+SPO_INLINE spo_bool_t spo_internal_process_cookie_packet(spo_host_data_t *host,
+    const spo_net_address_t *src_address, spo_packet_type_t packet_type, uint16_t src_port, uint16_t dst_port,
+    uint32_t seq, uint32_t ack, const uint8_t *data, uint32_t data_size)
+{
+    spo_connection_data_t *connection;
+    uint64_t interval;
+
+    if (packet_type != SPO_PACKET_ACK && packet_type != SPO_PACKET_PING && packet_type != SPO_PACKET_DATA)
+        return SPO_FALSE;
+    if (spo_internal_cookies_pending(host) == SPO_FALSE)
+        return SPO_FALSE;
+
+    /* nothing is acknowledged by the other side yet, so its SEQ is still the initial one */
+    interval = spo_internal_get_cookie_interval(host);
+    if (ack != spo_internal_make_cookie(host, src_address, src_port, dst_port, seq, interval) &&
+        ack != spo_internal_make_cookie(host, src_address, src_port, dst_port, seq, interval - 1))
+        return SPO_FALSE;
+
+    if (spo_internal_find_active_connection(host, src_address, src_port) != NULL)
+        return SPO_FALSE;
+
+    if (host->connections.length >= host->configuration.max_connections)
+    {
+        /* the other side has proved its address, so it takes place of the oldest half-open connection */
+        connection = spo_internal_find_oldest_incoming_connection(host);
+        if (connection == NULL)
+            return SPO_FALSE;
+
+        spo_internal_terminate_connection(connection);
+    }
+
+    connection = spo_internal_create_connection(host, dst_port);
+    if (connection == NULL)
+        return SPO_FALSE;
+
+    SPO_LOG("valid cookie received");
+    ++host->statistics.connect_cookies_accepted;
+
+    /* restore the state of the connection as if it was in 'incoming_connections' list */
+    connection->state = SPO_CONNECTION_STATE_CONNECT_RECEIVED;
+    connection->remote_address = *src_address;
+    connection->remote_port = src_port;
+    connection->rcv_start_seq = seq;
+    connection->snd_start_seq = ack;
+    connection->snd_next_seq = ack;
+    connection->snd_last_packet_time = host->time;
+
+    /* the connection is completed by the next packet if this one can't be accepted */
+    if (spo_list_add_item(&host->incoming_connections, connection) == NULL)
+    {
+        spo_internal_terminate_connection(connection);
+        return SPO_TRUE;
+    }
+
+    spo_internal_process_incoming_connection_confirming_packet(connection, packet_type, src_port, seq, ack, data, data_size);
+    return SPO_TRUE;
+}
+
+SPO_INLINE void spo_internal_process_incoming_connection_packet(spo_host_data_t *host,
+    const spo_net_address_t *src_address, uint16_t src_port, uint32_t seq)
+{
+    spo_connection_data_t *connection = spo_internal_find_active_connection(host, src_address, src_port);
+    if (connection != NULL)
+    {
+        /* looks like duplicate CONNECT, so update receive time and ignore the packet */
+        connection->rcv_last_packet_time = connection->host->time;
+        SPO_LOG("duplicate CONNECT received");
+        return;
+    }
+
+    connection = spo_internal_find_started_connection(host, src_address);
+    if (connection != NULL)
+        spo_internal_process_rendezvous_connection_packet(connection, src_port, seq);
+    else
+        spo_internal_process_incoming_connection_initial_packet(host, src_address, src_port, seq);
+}
+
+SPO_INLINE void spo_internal_update_lost_ranges(spo_connection_data_t *connection, uint32_t start_seq,
+    uint32_t size, uint32_t last_acked_seq)
+{
+    uint32_t hole_start;
+    spo_index_item_t *last_range = NULL;
+
+    if (!connection->snd_lost_ranges_valid)
+        return;
+
+    if (!spo_internal_remove_lost_range(connection, start_seq, start_seq + size))
+    {
+        spo_internal_invalidate_lost_ranges(connection);
+        return;
+    }
+
+    /* the data between the last SACK and the new one are lost too, unless they are queued already */
+    hole_start = SPO_WRAPPED_MAX(last_acked_seq, connection->snd_retransmit_next_seq);
+    if (connection->snd_lost_ranges.length > 0)
+    {
+        last_range = connection->snd_lost_ranges.items + connection->snd_lost_ranges.length - 1;
+        hole_start = SPO_WRAPPED_MAX(hole_start, last_range->start + last_range->size);
+    }
+
+    if (SPO_WRAPPED_LESS(hole_start, start_seq))
+    {
+        if (spo_index_insert_item_after(&connection->snd_lost_ranges, last_range, hole_start, start_seq - hole_start) == NULL)
+            spo_internal_invalidate_lost_ranges(connection);
+    }
+}
+
+SPO_INLINE void spo_internal_process_acks_list(spo_connection_data_t *connection, const spo_packet_desc_t *acks_list, unsigned acks_count)
+{
+    spo_index_t *acked_packets = &connection->snd_acked_packets;
+    uint32_t start_seq;
+    uint32_t size;
+    uint32_t last_acked_seq;
+    unsigned ack = 0;
+
+    while (ack < acks_count)
+    {
+        start_seq = acks_list[ack].start;
+        size = acks_list[ack].size;
+
+        /* check if the data are in send buffer */
+        if (SPO_WRAPPED_GREATER_EQ(start_seq, connection->snd_start_seq) &&
+            SPO_WRAPPED_LESS_EQ(start_seq + size, connection->snd_next_seq))
+        {
+            /* end of the last acked packet, the data after it aren't considered lost yet */
+            last_acked_seq = connection->snd_start_seq;
+            if (acked_packets->length > 0)
+                last_acked_seq = SPO_WRAPPED_MAX(last_acked_seq,
+                    acked_packets->items[acked_packets->length - 1].start + acked_packets->items[acked_packets->length - 1].size);
+
+            /* save description of the new data */
+            if (spo_index_merge_item(acked_packets, start_seq, size) == SPO_FALSE)
+                break;
+
+            if (connection->snd_recovery_mode != SPO_RECOVERY_OFF)
+                spo_internal_update_lost_ranges(connection, start_seq, size, last_acked_seq);
+        }
+
+        ++ack;
+    }
+}
+
+SPO_INLINE void spo_internal_remove_old_acks(spo_connection_data_t *connection, uint32_t ack)
+{
+    spo_index_item_t *current = SPO_INDEX_FIRST(&connection->snd_acked_packets);
+
+    /* the head is removed without moving the rest of the list */
+    while (SPO_INDEX_VALID(&connection->snd_acked_packets, current))
+    {
+        if (SPO_WRAPPED_LESS_EQ(ack, current->start)) /* packet from the future */
+            break;
+
+        if (SPO_WRAPPED_LESS(ack, current->start + current->size))
+        {
+            /* the data are not fully acknowledged */
+            /* it should not happen, so something is wrong */
+            current = SPO_INDEX_NEXT(&connection->snd_acked_packets, current);
+        }
+        else
+        {
+            /* remove old packet */
+            current = spo_index_remove_item(&connection->snd_acked_packets, current);
+        }
+    }
+
+    if (connection->snd_recovery_mode != SPO_RECOVERY_OFF)
+        spo_internal_release_lost_ranges(connection, ack);
+}
+
+SPO_INLINE void spo_internal_process_established_connection_packet(spo_connection_data_t *connection,
+    spo_packet_type_t packet_type, uint16_t src_port, uint32_t seq, uint32_t ack,
+    const spo_packet_desc_t *acks_list, unsigned acks_count,
+    const uint8_t *data, uint32_t data_size)
+{
+    if (src_port != connection->remote_port)
+        return;
+    if (spo_internal_check_ack(connection, ack) == SPO_FALSE)
+        return;
+
+    connection->rcv_last_packet_time = connection->host->time;
+
+    if (packet_type == SPO_PACKET_RESET)
+    {
+        if (seq == connection->rcv_start_seq)
+        {
+            /* RESET is valid */
+            spo_internal_terminate_connection(connection);
+        }
+        else if (spo_internal_check_seq(connection, seq))
+        {
+            /* send ACK, so other side can confirm the RESET */
+            if (connection->snd_mandatory_packets == 0)
+                connection->snd_mandatory_packets = 1;
+        }
+        return;
+    }
+
+    if (packet_type == SPO_PACKET_CHALLENGE)
+    {
+        /* our address has changed for the other side, it is proved by the echo from that address */
+        spo_internal_send_stateless_packet(connection->host, SPO_PACKET_RESPONSE, &connection->remote_address,
+            connection->local_port, connection->remote_port, seq, connection->rcv_start_seq);
+        return;
+    }
+
+    /* sender */
+    if (connection->snd_buf_bytes > 0)
+    {
+        uint32_t bytes_sent = spo_internal_remove_acknowledged_packets(connection, ack);
+        if (bytes_sent > 0)
+        {
+            spo_internal_remove_old_acks(connection, ack);
+            spo_internal_process_acks_list(connection, acks_list, acks_count);
+            spo_internal_handle_sent_data_acknowledged(connection, bytes_sent);
+        }
+        else
+        {
+            spo_internal_process_acks_list(connection, acks_list, acks_count);
+            if (packet_type != SPO_PACKET_PING)
+                spo_internal_handle_unknown_ack(connection, ack);
+        }
+    }
+    /* receiver */
+    if (data_size > 0)
+    {
+        if (spo_internal_fill_rcv_buffer(connection, seq, data, data_size))
+            spo_internal_handle_new_data_received(connection);
+    }
+}
+
+/* the nonce can't be guessed by anyone who doesn't see the CHALLENGE */
+SPO_INLINE uint32_t spo_internal_make_migration_nonce(spo_connection_data_t *connection, const spo_net_address_t *address)
+{
+    uint8_t data[SPO_NET_IPV6_ADDRESS_SIZE + sizeof(uint16_t) * 2 + sizeof(spo_time_t)];
+    uint8_t *current = data;
+
+    memcpy(current, address->address, SPO_NET_IPV6_ADDRESS_SIZE);
+    current += SPO_NET_IPV6_ADDRESS_SIZE;
+    memcpy(current, &address->port, sizeof(uint16_t));
+    current += sizeof(uint16_t);
+    memcpy(current, &connection->local_port, sizeof(uint16_t));
+    current += sizeof(uint16_t);
+    memcpy(current, &connection->host->time, sizeof(spo_time_t));
+
+    return (uint32_t)spo_siphash(connection->host->secret_key, data, sizeof(data));
+}
+
+/* packets of the connection came from another address, packets are not accepted until the address is validated,
+   the invalid ones are dropped silently, so the host can't be used to reflect packets to a spoofed address */
+SPO_INLINE void spo_internal_process_migrating_connection_packet(spo_connection_data_t *connection,
+    const spo_net_address_t *src_address, spo_packet_type_t packet_type, uint16_t src_port, uint32_t seq, uint32_t ack)
+{
+    spo_host_data_t *host = connection->host;
+
+    if (src_port != connection->remote_port)
+        return;
+    if (spo_internal_check_ack(connection, ack) == SPO_FALSE)
+        return;
+
+    if (packet_type == SPO_PACKET_RESPONSE)
+    {
+        if (connection->cold.migration_pending && seq == connection->cold.migration_nonce &&
+            spo_net_equal_addresses(src_address, &connection->cold.migration_address))
+        {
+            SPO_LOG("connection migrated");
+
+            connection->remote_address = *src_address;
+            connection->cold.migration_pending = SPO_FALSE;
+
+            /* congestion state is kept, only the path-dependent parts start over */
+            connection->snd_duplicate_acks = 0;
+            connection->rcv_last_packet_time = host->time;
+
+            /* packets were dropped during the validation, so tell the other side where we are */
+            if (connection->snd_mandatory_packets == 0)
+                connection->snd_mandatory_packets = 1;
+
+            spo_internal_wake_connection(connection);
+            ++host->statistics.connections_migrated;
+        }
+        return;
+    }
+
+    /* only the packets of the current window start the migration, the ports alone are easy to guess,
+       PING is accepted too as it's all an idle connection sends after the address has changed */
+    if (packet_type != SPO_PACKET_DATA && packet_type != SPO_PACKET_ACK && packet_type != SPO_PACKET_PING)
+        return;
+    if (spo_internal_check_seq(connection, seq) == SPO_FALSE)
+        return;
+
+    /* one address is challenged at a time, so spoofed packets can't cause a flood of challenges */
+    if (connection->cold.migration_pending &&
+        !spo_internal_time_elapsed(host, connection->cold.migration_time, SPO_MIGRATION_CHALLENGE_INTERVAL))
+        return;
+
+    connection->cold.migration_address = *src_address;
+    connection->cold.migration_time = host->time;
+    connection->cold.migration_nonce = spo_internal_make_migration_nonce(connection, src_address);
+    connection->cold.migration_pending = SPO_TRUE;
+
+    spo_internal_send_stateless_packet(host, SPO_PACKET_CHALLENGE, src_address,
+        connection->local_port, connection->remote_port, connection->cold.migration_nonce, connection->rcv_start_seq);
+    ++host->statistics.migration_challenges_sent;
+
+    SPO_LOG("CHALLENGE sent");
+}
+
+SPO_INLINE void spo_internal_process_packet(spo_host_data_t *host,
+    const spo_net_address_t *src_address, const uint8_t *packet_data, uint32_t packet_size)
+{
+    spo_packet_desc_t acks_list[SPO_PACKET_MAX_SACKS];
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint32_t seq;
+    uint32_t ack;
+    unsigned acks_count;
+    spo_packet_type_t packet_type;
+    spo_connection_data_t *connection;
+    spo_packet_header_t *header = (spo_packet_header_t *)packet_data;
+
+    if (packet_size < sizeof(spo_packet_header_t))
+        return;
+
+    packet_type = header->type;
+    acks_count = header->sacks;
+    src_port = spo_internal_swap_2bytes(header->src_port);
+    dst_port = spo_internal_swap_2bytes(header->dst_port);
+    seq = spo_internal_swap_4bytes(header->seq);
+    ack = spo_internal_swap_4bytes(header->ack);
+
+    if (acks_count > 0)
+    {
+        if (acks_count > SPO_PACKET_MAX_SACKS)
+            return;
+
+        if (packet_size < SPO_HEADER_SIZE(acks_count))
+            return;
+
+        spo_internal_unpack_acks(acks_list, packet_data + sizeof(spo_packet_header_t),
+            packet_size - sizeof(spo_packet_header_t), acks_count);
+    }
+
+    SPO_LOG("incoming packet (SEQ %u, ACK %u, acks %hu, %u bytes)",
+        seq, ack, acks_count, packet_size - SPO_HEADER_SIZE(acks_count));
+
+    if (dst_port == 0) /* incoming connection */
+    {
+        if (packet_type == SPO_PACKET_CONNECT && spo_internal_allow_connect(host, src_address))
+            spo_internal_process_incoming_connection_packet(host, src_address, src_port, seq);
+        return;
+    }
+
+    /* find connection */
+    connection = host->connections_by_ports[dst_port];
+    if (connection == NULL)
+    {
+        if (spo_internal_process_cookie_packet(host, src_address, packet_type, src_port, dst_port, seq, ack,
+            packet_data + SPO_HEADER_SIZE(acks_count), packet_size - SPO_HEADER_SIZE(acks_count)))
+            return;
+
+        /* the other side may be waiting for its cookie to be validated, so don't reset it */
+        if (packet_type != SPO_PACKET_RESET && spo_internal_cookies_pending(host) == SPO_FALSE &&
+            spo_internal_allow_reset(host, src_address))
+            spo_internal_send_reset_packet(host, src_address, dst_port, src_port, ack, seq); /* reset connection */
+        return;
+    }
+
+    /* check remote address */
+    if (spo_net_equal_addresses(src_address, &connection->remote_address) == SPO_FALSE)
+    {
+        if (connection->state == SPO_CONNECTION_STATE_CONNECTED && host->configuration.allow_migration)
+            spo_internal_process_migrating_connection_packet(connection, src_address, packet_type, src_port, seq, ack);
+        return;
+    }
+
+    /* check if packet type is valid */
+    if (spo_allowed_packets[connection->state][packet_type] == SPO_FALSE)
+    {
+        SPO_LOG("illegal packet type %u", packet_type);
+        return;
+    }
+
+    /* wake the connection before processing as the packet may terminate it */
+    spo_internal_wake_connection(connection);
+
+    switch (connection->state)
+    {
+    case SPO_CONNECTION_STATE_CONNECT_STARTED:
+        spo_internal_process_started_connection_packet(connection, packet_type, src_port, seq, ack);
+        break;
+    case SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED:
+    case SPO_CONNECTION_STATE_CONNECT_RECEIVED:
+        spo_internal_process_incoming_connection_confirming_packet(connection, packet_type, src_port, seq, ack,
+            packet_data + SPO_HEADER_SIZE(acks_count), packet_size - SPO_HEADER_SIZE(acks_count));
+        break;
+    case SPO_CONNECTION_STATE_CONNECTED:
+        spo_internal_process_established_connection_packet(connection,
+            packet_type, src_port, seq, ack, acks_list, acks_count,
+            packet_data + SPO_HEADER_SIZE(acks_count), packet_size - SPO_HEADER_SIZE(acks_count));
+        break;
+    }
+}
+
+/* ready data of a posted buffer are consumed once the data before it are read, so the receive window keeps moving,
+   returns SPO_TRUE if some data are consumed */
+SPO_INLINE spo_bool_t spo_internal_fill_posted_buffers(spo_connection_data_t *connection)
+{
+    spo_receive_buffer_t buffer;
+    spo_receive_buffer_t *current;
+    uint32_t bytes_filled;
+    spo_bool_t filled = SPO_FALSE;
+
+    while ((current = connection->rcv_posted_buffers) != NULL &&
+        SPO_WRAPPED_LESS_EQ(current->start_seq, connection->rcv_start_seq))
     {
-        uint32_t bytes_sent = spo_internal_remove_acknowledged_packets(connection, ack);
+        bytes_filled = SPO_MIN(connection->rcv_bytes_ready, current->start_seq + current->size - connection->rcv_start_seq);
+        if (bytes_filled == 0)
+            break;
+
+        spo_internal_release_read_data(connection, bytes_filled);
+        filled = SPO_TRUE;
+
+        if (connection->rcv_start_seq != current->start_seq + current->size)
+            break;
+
+        /* unlink the buffer before the event, so the user code can post the next one */
+        connection->rcv_posted_buffers = current->next_buffer;
+        if (connection->rcv_posted_buffers == NULL)
+            connection->rcv_last_posted_buffer = NULL;
+        buffer = *current;
+        spo_slab_free(&connection->host->receive_buffers_slab, current);
+
+        spo_internal_fire_receive_completion_event(connection, &buffer, SPO_TRUE);
+    }
+
+    return filled;
+}
+
+SPO_INLINE spo_bool_t spo_internal_check_received_data(spo_connection_data_t *connection)
+{
+    uint32_t bytes_ready;
+    uint32_t bytes_received = spo_internal_consume_received_ranges(connection);
+    spo_bool_t state_changed = SPO_FALSE;
+
+    if (bytes_received > 0)
+    {
+        connection->rcv_bytes_ready += bytes_received;
+        state_changed = SPO_TRUE;
+    }
+
+    if (spo_internal_fill_posted_buffers(connection))
+        state_changed = SPO_TRUE;
+
+    /* the user code is notified about the data it can read */
+    bytes_ready = spo_internal_get_readable_bytes(connection);
+    if (bytes_received > 0 && bytes_ready > 0)
+        spo_internal_fire_incoming_data_event(connection, bytes_ready);
+
+    return state_changed;
+}
+
+SPO_INLINE spo_bool_t spo_internal_check_connection_timeout(spo_connection_data_t *connection)
+{
+    if (spo_internal_time_elapsed(connection->host, connection->rcv_last_packet_time,
+        connection->parameters.connection_timeout))
+    {
+        spo_internal_terminate_connection(connection);
+        return SPO_TRUE;
+    }
+
+    return SPO_FALSE;
+}
+
+SPO_INLINE spo_bool_t spo_internal_send_ping_packet(spo_connection_data_t *connection)
+{
+    if (spo_internal_time_elapsed(connection->host, connection->snd_last_packet_time,
+        connection->parameters.ping_interval))
+    {
+        if (!spo_internal_send_packet(connection, SPO_PACKET_PING, connection->snd_start_seq, 0, NULL))
+            return SPO_FALSE; /* the socket is full, try again on the next progress call */
+
+        SPO_LOG("PING sent, ACK %u", connection->rcv_start_seq);
+        return SPO_TRUE;
+    }
+
+    return SPO_FALSE;
+}
+
+SPO_INLINE spo_bool_t spo_internal_send_fast_ack(spo_connection_data_t *connection)
+{
+    if (connection->snd_mandatory_packets > 0)
+    {
+        if (!spo_internal_send_packet(connection, SPO_PACKET_ACK, connection->snd_start_seq, 0, NULL))
+            return SPO_FALSE; /* the socket is full, try again on the next progress call */
+
+        SPO_LOG("ACK %u sent", connection->rcv_start_seq);
+        return SPO_TRUE;
+    }
+
+    return SPO_FALSE;
+}
+
+SPO_INLINE uint32_t spo_internal_send_next_connection_data(spo_connection_data_t *connection, uint32_t cwnd_bytes)
+{
+    uint32_t bytes_sent_already = connection->snd_next_seq - connection->snd_start_seq;
+    uint32_t max_bytes_limit = SPO_MIN(connection->snd_buf_bytes, cwnd_bytes);
+
+    if (bytes_sent_already < max_bytes_limit) /* connection is allowed to send data */
+    {
+        /* send next data packet */
+        uint32_t bytes_sent = spo_internal_send_data_packets(connection, connection->snd_next_seq, 1,
+            bytes_sent_already, max_bytes_limit - bytes_sent_already);
+
         if (bytes_sent > 0)
         {
-            spo_internal_remove_old_acks(connection, ack);
-            spo_internal_process_acks_list(connection, acks_list, acks_count);
-            spo_internal_handle_sent_data_acknowledged(connection, bytes_sent);
+            SPO_LOG("data sent (%u bytes, SEQ %u, ACK %u)",
+                bytes_sent, connection->snd_next_seq, connection->rcv_start_seq);
+
+            connection->snd_next_seq += bytes_sent;
+
+            spo_internal_handle_next_data_sent(connection);
+        }
+
+        return bytes_sent;
+    }
+
+    return 0;
+}
+
+SPO_INLINE uint32_t spo_internal_transmit_packet(spo_connection_data_t *connection, uint32_t seq)
+{
+    uint32_t pos_in_buf = seq - connection->snd_start_seq;
+
+    if (pos_in_buf < connection->snd_buf_bytes)
+    {
+        /* send specified data packet */
+        uint32_t bytes_sent = spo_internal_send_data_packets(connection, seq, 1,
+            pos_in_buf, connection->snd_buf_bytes - pos_in_buf);
+
+        if (bytes_sent > 0)
+        {
+            if (SPO_WRAPPED_LESS(seq, connection->snd_next_seq))
+                connection->host->statistics.data_bytes_retransmitted +=
+                    SPO_MIN(bytes_sent, connection->snd_next_seq - seq);
+
+            /* 'snd_next_seq' always points to the next seq to send */
+            if (SPO_WRAPPED_LESS(connection->snd_next_seq, seq + bytes_sent))
+                connection->snd_next_seq = seq + bytes_sent;
+
+            return bytes_sent;
+        }
+    }
+
+    return 0;
+}
+
+SPO_INLINE spo_bool_t spo_internal_process_established_connection(spo_connection_data_t *connection)
+{
+    /* can't transmit data if send buffer is empty */
+    if (connection->snd_buf_bytes > 0 && spo_internal_handle_data_transmission(connection))
+        return SPO_TRUE;
+
+    /* can't send data, so send a special packet */
+
+    if (spo_internal_send_fast_ack(connection))
+        return SPO_TRUE;
+
+    if (spo_internal_send_ping_packet(connection))
+        return SPO_TRUE;
+
+    return SPO_FALSE;
+}
+
+/* retransmission timeout doubles with each attempt, jitter keeps the connections started together apart */
+SPO_INLINE spo_time_t spo_internal_get_connect_backoff(spo_connection_data_t *connection)
+{
+    uint32_t shift = SPO_MIN(connection->cold.connect_attempts - 1, SPO_MAX_CONNECT_BACKOFF_SHIFT);
+    spo_time_t timeout = SPO_TIME_FROM_MSECS(connection->host->configuration.connect_retransmission_timeout) << shift;
+
+    /* +-25% */
+    return timeout - timeout / 4 + spo_random_next() % (timeout / 2 + 1);
+}
+
+SPO_INLINE spo_bool_t spo_internal_process_started_connection(spo_connection_data_t *connection)
+{
+    spo_host_data_t *host = connection->host;
+
+    if (host->time >= connection->cold.connect_time)
+    {
+        if (connection->cold.connect_attempts < host->configuration.max_connect_attempts)
+        {
+            if (!spo_internal_allow_connect_packet(connection))
+                return SPO_FALSE;
+
+            if (connection->cold.connect_attempts == 0)
+                ++host->connects_in_flight;
+
+            spo_internal_send_packet(connection, SPO_PACKET_CONNECT, connection->snd_start_seq, 0, NULL);
+            ++connection->cold.connect_attempts;
+            connection->cold.connect_time = host->time + spo_internal_get_connect_backoff(connection);
+
+            SPO_LOG("CONNECT sent");
         }
         else
         {
-            spo_internal_process_acks_list(connection, acks_list, acks_count);
-            if (packet_type != SPO_PACKET_PING)
-                spo_internal_handle_unknown_ack(connection, ack);
+            spo_internal_terminate_connection(connection);
         }
+
+        return SPO_TRUE;
     }
-    /* receiver */
-    if (data_size > 0)
+
+    return SPO_FALSE;
+}
+
+SPO_INLINE spo_bool_t spo_internal_process_incoming_connection(spo_connection_data_t *connection)
+{
+    if (spo_internal_time_elapsed(connection->host, connection->snd_last_packet_time,
+        connection->host->configuration.accept_retransmission_timeout))
     {
-        if (spo_internal_fill_rcv_buffer(connection, seq, data, data_size))
-            spo_internal_handle_new_data_received(connection);
+        if (connection->cold.connect_attempts < connection->host->configuration.max_accepted_attempts)
+        {
+            spo_internal_send_packet(connection, SPO_PACKET_ACCEPT, connection->snd_start_seq, 0, NULL);
+            ++connection->cold.connect_attempts;
+
+            SPO_LOG("ACCEPTED sent");
+        }
+        else
+        {
+            spo_internal_terminate_connection(connection);
+        }
+
+        return SPO_TRUE;
     }
+
+    return SPO_FALSE;
 }
 
-SPO_INLINE void spo_internal_process_packet(spo_host_data_t *host,
-    const spo_net_address_t *src_address, const uint8_t *packet_data, uint32_t packet_size)
+SPO_INLINE void spo_internal_check_hibernation(spo_connection_data_t *connection)
 {
-    spo_packet_desc_t acks_list[SPO_PACKET_MAX_SACKS];
-    uint16_t src_port;
-    uint16_t dst_port;
-    uint32_t seq;
-    uint32_t ack;
-    unsigned acks_count;
-    spo_packet_type_t packet_type;
+    if (spo_internal_can_hibernate(connection) && spo_internal_time_elapsed(connection->host,
+        spo_internal_get_last_data_time(connection), connection->parameters.hibernation_timeout))
+    {
+        /* release arrays, they are allocated again on the next data packet or spo_send() */
+        spo_segment_chain_destroy(&connection->rcv_buf, &connection->host->segments_pool);
+        spo_segment_chain_destroy(&connection->snd_buf, &connection->host->segments_pool);
+        spo_index_destroy(&connection->rcv_packets);
+        spo_bitmap_destroy(&connection->rcv_bitmap);
+        spo_index_destroy(&connection->snd_acked_packets);
+        spo_index_destroy(&connection->snd_lost_ranges);
+
+        SPO_LOG("connection hibernated");
+    }
+}
+
+SPO_INLINE spo_bool_t spo_internal_process_connection(spo_connection_data_t *connection)
+{
+    spo_bool_t state_changed = SPO_FALSE;
+
+    switch (connection->state)
+    {
+    case SPO_CONNECTION_STATE_CONNECT_STARTED:
+        if (spo_internal_process_started_connection(connection))
+            state_changed = SPO_TRUE;
+        break;
+    case SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED:
+    case SPO_CONNECTION_STATE_CONNECT_RECEIVED:
+        if (spo_internal_process_incoming_connection(connection))
+            state_changed = SPO_TRUE;
+        break;
+    case SPO_CONNECTION_STATE_CONNECTED:
+        if (spo_internal_check_connection_timeout(connection))
+        {
+            state_changed = SPO_TRUE;
+            break;
+        }
+
+        if (spo_internal_release_user_buffers(connection, SPO_TRUE))
+            state_changed = SPO_TRUE;
+        if (spo_internal_check_received_data(connection))
+            state_changed = SPO_TRUE;
+        if (spo_internal_process_established_connection(connection))
+            state_changed = SPO_TRUE;
+        else
+            spo_internal_check_hibernation(connection);
+        break;
+    }
+
+    return state_changed;
+}
+
+/* returns count of the connections which have done some work, each one sends no more than one packet */
+SPO_INLINE uint32_t spo_internal_process_connections(spo_host_data_t *host, uint32_t max_connections)
+{
+    uint32_t connections_processed = 0;
+    uint32_t slots_scanned = 0;
     spo_connection_data_t *connection;
-    spo_packet_header_t *header = (spo_packet_header_t *)packet_data;
+    spo_timers_t *timers = &host->timers;
+    uint32_t slot = timers->next_slot;
 
-    if (packet_size < sizeof(spo_packet_header_t))
-        return;
+    spo_internal_update_time(host);
 
-    packet_type = header->type;
-    acks_count = header->sacks;
-    src_port = spo_internal_swap_2bytes(header->src_port);
-    dst_port = spo_internal_swap_2bytes(header->dst_port);
-    seq = spo_internal_swap_4bytes(header->seq);
-    ack = spo_internal_swap_4bytes(header->ack);
+    /* scan all the slots once, starting from the place where the previous scan has stopped */
+    while (slots_scanned < timers->count && connections_processed < max_connections)
+    {
+        if (slot >= timers->count)
+            slot = 0;
+
+        ++slots_scanned;
+
+        if (timers->deadlines[slot] > host->time) /* nothing to do yet */
+        {
+            ++slot;
+            continue;
+        }
+
+        connection = timers->connections[slot];
+
+        if (spo_internal_process_connection(connection))
+        {
+            ++connections_processed;
+
+            /* the connection may have more work, so don't reschedule it */
+            if (slot < timers->count && timers->connections[slot] == connection)
+                timers->deadlines[slot] = 0;
+        }
+        else if (slot < timers->count && timers->connections[slot] == connection)
+            timers->deadlines[slot] = spo_internal_get_connection_deadline(connection);
+
+        /* terminated connections release their slots, so the slot can contain another connection now */
+        if (slot < timers->count && timers->connections[slot] == connection)
+            ++slot;
+    }
+
+    timers->next_slot = slot;
+    return connections_processed;
+}
+
+SPO_INLINE spo_connection_data_t *spo_internal_start_connection(spo_host_data_t *host, const spo_net_address_t *remote_address)
+{
+    spo_connection_data_t *connection = spo_internal_allocate_connection(host);
+    if (connection == NULL)
+        return NULL;
+
+    /* add connection to 'started_connections' list */
+    if (spo_list_add_item(&host->started_connections, connection) == NULL)
+    {
+        spo_internal_terminate_connection(connection);
+        return NULL;
+    }
+
+    SPO_LOG("CONNECT started");
+
+    connection->state = SPO_CONNECTION_STATE_CONNECT_STARTED;
+    connection->remote_address = *remote_address;
+    connection->cold.connect_time = host->time;
+
+    return connection;
+}
+
+/* connection pools */
+
+SPO_INLINE void spo_internal_replenish_pool(spo_pool_data_t *pool)
+{
+    spo_connection_data_t *connection;
 
-    if (acks_count > 0)
+    while (pool->connections.length < pool->size)
     {
-        if (acks_count > SPO_PACKET_MAX_SACKS)
-            return;
+        connection = spo_internal_start_connection(pool->host, &pool->address);
+        if (connection == NULL)
+            return; /* try again on the next progress step */
 
-        if (packet_size < SPO_HEADER_SIZE(acks_count))
-            return;
+        connection->cold.pool = pool;
 
-        spo_internal_unpack_acks(acks_list, packet_data + sizeof(spo_packet_header_t),
-            packet_size - sizeof(spo_packet_header_t), acks_count);
+        if (spo_list_add_item(&pool->connections, connection) == NULL)
+        {
+            spo_internal_terminate_connection(connection);
+            return;
+        }
     }
+}
 
-    SPO_LOG("incoming packet (SEQ %u, ACK %u, acks %hu, %u bytes)",
-        seq, ack, acks_count, packet_size - SPO_HEADER_SIZE(acks_count));
+SPO_INLINE void spo_internal_replenish_pools(spo_host_data_t *host)
+{
+    spo_list_item_t *current = SPO_LIST_FIRST(&host->pools);
 
-    if (dst_port == 0) /* incoming connection */
+    while (SPO_LIST_VALID(&host->pools, current))
     {
-        if (packet_type == SPO_PACKET_CONNECT)
-            spo_internal_process_incoming_connection_packet(host, src_address, src_port, seq);
-        return;
+        spo_internal_replenish_pool((spo_pool_data_t *)current->data);
+        current = SPO_LIST_NEXT(&host->pools, current);
     }
+}
 
-    /* find connection */
-    connection = host->connections_by_ports[dst_port];
-    if (connection == NULL)
-    {
-        if (packet_type != SPO_PACKET_RESET)
-            spo_internal_send_reset_packet(host, src_address, dst_port, src_port, ack, seq); /* reset connection */
-        return;
-    }
+/* returns count of the receive attempts, it's less than 'max_packets' if the socket has no more data */
+SPO_INLINE uint32_t spo_internal_receive_packets(spo_host_data_t *host, uint32_t max_packets)
+{
+    uint8_t packet_data[SPO_NET_MAX_PACKET_SIZE];
+    spo_net_address_t address;
+    uint32_t bytes_received;
+    uint32_t packets_received = 0;
 
-    /* check remote address */
-    if (spo_net_equal_addresses(src_address, &connection->remote_address) == SPO_FALSE)
-        return;
+    /* all packets of the batch share the same receive time */
+    spo_internal_update_time(host);
 
-    /* check if packet type is valid */
-    if (spo_allowed_packets[connection->state][packet_type] == SPO_FALSE)
+    while (packets_received < max_packets && spo_net_data_available(host->socket))
     {
-        SPO_LOG("illegal packet type %u", packet_type);
-        return;
-    }
+        bytes_received = spo_net_recv(host->socket, packet_data, sizeof(packet_data), &address);
+        if (bytes_received > 0)
+            spo_internal_process_packet(host, &address, packet_data, bytes_received);
 
-    switch (connection->state)
-    {
-    case SPO_CONNECTION_STATE_CONNECT_STARTED:
-        spo_internal_process_started_connection_packet(connection, packet_type, src_port, seq, ack);
-        break;
-    case SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED:
-    case SPO_CONNECTION_STATE_CONNECT_RECEIVED:
-        spo_internal_process_incoming_connection_confirming_packet(connection, packet_type, src_port, seq, ack,
-            packet_data + SPO_HEADER_SIZE(acks_count), packet_size - SPO_HEADER_SIZE(acks_count));
-        break;
-    case SPO_CONNECTION_STATE_CONNECTED:
-        spo_internal_process_established_connection_packet(connection,
-            packet_type, src_port, seq, ack, acks_list, acks_count,
-            packet_data + SPO_HEADER_SIZE(acks_count), packet_size - SPO_HEADER_SIZE(acks_count));
-        break;
+        ++packets_received;
     }
+
+    return packets_received;
 }
 
-SPO_INLINE spo_bool_t spo_internal_check_received_data(spo_connection_data_t *connection)
+/* returns SPO_TRUE if the budget is spent before all the pending work is done,
+   the budget is charged by the received and the sent packets */
+SPO_INLINE spo_bool_t spo_internal_make_progress(spo_host_data_t *host,
+    uint32_t max_packets, uint32_t max_usecs, spo_bool_t *work_done)
 {
-    spo_packet_desc_t *packet_desc;
-    uint32_t packet_end;
-    uint32_t expected_seq;
-    uint32_t bytes_received = 0;
-    spo_index_item_t *current = SPO_INDEX_FIRST(&connection->rcv_packets);
+    uint32_t packets_received;
+    uint32_t packets_sent;
+    uint32_t connections_processed;
+    uint32_t packets = 0;
+    spo_time_t start_time;
 
-    while (SPO_INDEX_VALID(&connection->rcv_packets, current))
+    spo_internal_update_time(host);
+    start_time = host->time;
+
+    /* replace the connections taken from the pools or lost */
+    spo_internal_replenish_pools(host);
+
+    while (1)
     {
-        packet_desc = (spo_packet_desc_t *)current->data;
+        packets_sent = host->packets_sent;
 
-        packet_end = packet_desc->start + packet_desc->size;
-        expected_seq = connection->rcv_start_seq + connection->rcv_bytes_ready + bytes_received;
+        packets_received = spo_internal_receive_packets(host, SPO_MIN(SPO_RECEIVE_BATCH, max_packets - packets));
+        packets += packets_received;
 
-        if (SPO_WRAPPED_LESS(expected_seq, packet_desc->start)) /* a hole in the data */
-            break;
+        connections_processed = spo_internal_process_connections(host, max_packets - packets);
 
-        if (SPO_WRAPPED_LESS(expected_seq, packet_end)) /* packet has new data */
-            bytes_received += (packet_end - expected_seq);
+        packets_sent = host->packets_sent - packets_sent;
+        packets += packets_sent;
 
-        /* one more case: it is an old packet, so we can simply destroy it */
+        if (packets_received > 0 || connections_processed > 0)
+            *work_done = SPO_TRUE;
 
-        free(packet_desc);
-        current = spo_index_remove_item(&connection->rcv_packets, current);
+        /* nothing is received or sent, so the rest of the work waits for the timers or for the socket */
+        if (packets_received == 0 && packets_sent == 0)
+            return SPO_FALSE;
+
+        if (packets >= max_packets)
+            return SPO_TRUE;
+        if (max_usecs > 0 && host->time - start_time >= max_usecs)
+            return SPO_TRUE;
     }
+}
 
-    if (bytes_received > 0)
-    {
-        connection->rcv_bytes_ready += bytes_received;
+SPO_INLINE spo_bool_t spo_internal_preallocate_pools(spo_host_data_t *host)
+{
+    uint32_t max_connections = host->configuration.max_connections;
 
-        spo_internal_fire_incoming_data_event(connection, connection->rcv_bytes_ready);
+    /* each connection is a member of 'connections' list and of one of the handshake lists */
+    if (spo_slab_reserve(&host->connections_slab, max_connections) == SPO_FALSE)
+        return SPO_FALSE;
+    if (spo_slab_reserve(&host->list_items_slab, max_connections * 2) == SPO_FALSE)
+        return SPO_FALSE;
 
-        return SPO_TRUE;
-    }
+    return SPO_TRUE;
+}
 
-    return SPO_FALSE;
+/* live upgrade */
+
+/* state never leaves the machine, so the integers are stored in the host byte order, and the
+   monotonic time values stay valid in the other process */
+typedef struct
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t position; /* grows even if the data don't fit, so it's the required size in the end */
+} spo_state_writer_t;
+
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t position;
+} spo_state_reader_t;
+
+SPO_INLINE void spo_internal_write_state(spo_state_writer_t *writer, const void *data, uint32_t size)
+{
+    if (writer->position + size <= writer->size)
+        memcpy(writer->data + writer->position, data, size);
+
+    writer->position += size;
 }
 
-SPO_INLINE spo_bool_t spo_internal_check_connection_timeout(spo_connection_data_t *connection)
+/* the posted buffers are copied into the state, the other process gets their data as the buffered ones */
+SPO_INLINE void spo_internal_write_state_rcv_buffer(spo_state_writer_t *writer,
+    spo_connection_data_t *connection, uint32_t offset, uint32_t size)
 {
-    if (spo_time_elapsed(connection->rcv_last_packet_time) >= connection->host->configuration.connection_timeout)
-    {
-        spo_internal_terminate_connection(connection);
-        return SPO_TRUE;
-    }
+    if (size > 0 && writer->position + size <= writer->size)
+        spo_internal_read_rcv_buffer(connection, offset, writer->data + writer->position, size);
 
-    return SPO_FALSE;
+    writer->position += size;
 }
 
-SPO_INLINE spo_bool_t spo_internal_send_ping_packet(spo_connection_data_t *connection)
+/* the user buffers are copied into the state, the other process gets their data as the buffered ones */
+SPO_INLINE void spo_internal_write_state_send_buffer(spo_state_writer_t *writer, spo_connection_data_t *connection)
 {
-    if (spo_time_elapsed(connection->snd_last_packet_time) >= connection->host->configuration.ping_interval)
-    {
-        spo_internal_send_packet(connection, SPO_PACKET_PING, connection->snd_start_seq, NULL, 0);
-        SPO_LOG("PING sent, ACK %u", connection->rcv_start_seq);
-        return SPO_TRUE;
-    }
+    uint32_t size = connection->snd_buf_bytes;
 
-    return SPO_FALSE;
+    if (size > 0 && writer->position + size <= writer->size)
+        spo_internal_read_send_buffer(connection, 0, writer->data + writer->position, size);
+
+    writer->position += size;
 }
 
-SPO_INLINE spo_bool_t spo_internal_send_fast_ack(spo_connection_data_t *connection)
+SPO_INLINE spo_bool_t spo_internal_read_state(spo_state_reader_t *reader, void *data, uint32_t size)
 {
-    if (connection->snd_mandatory_packets > 0)
-    {
-        spo_internal_send_packet(connection, SPO_PACKET_ACK, connection->snd_start_seq, NULL, 0);
-        SPO_LOG("ACK %u sent", connection->rcv_start_seq);
-        return SPO_TRUE;
-    }
+    if (reader->size - reader->position < size)
+        return SPO_FALSE;
 
-    return SPO_FALSE;
+    memcpy(data, reader->data + reader->position, size);
+    reader->position += size;
+    return SPO_TRUE;
 }
 
-SPO_INLINE uint32_t spo_internal_send_next_connection_data(spo_connection_data_t *connection, uint32_t cwnd_bytes)
+/* returns NULL if the state is truncated */
+SPO_INLINE const uint8_t *spo_internal_read_state_buffer(spo_state_reader_t *reader, uint32_t size)
 {
-    uint32_t bytes_sent_already = connection->snd_next_seq - connection->snd_start_seq;
-    uint32_t max_bytes_limit = SPO_MIN(connection->snd_buf_bytes, cwnd_bytes);
+    const uint8_t *data = reader->data + reader->position;
 
-    if (bytes_sent_already < max_bytes_limit) /* connection is allowed to send data */
-    {
-        /* send next data packet */
-        uint32_t bytes_sent = spo_internal_send_data_packets(connection, connection->snd_next_seq, 1,
-            connection->snd_buf + bytes_sent_already, max_bytes_limit - bytes_sent_already);
+    if (reader->size - reader->position < size)
+        return NULL;
 
-        if (bytes_sent > 0)
-        {
-            SPO_LOG("data sent (%u bytes, SEQ %u, ACK %u)",
-                bytes_sent, connection->snd_next_seq, connection->rcv_start_seq);
+    reader->position += size;
+    return data;
+}
 
-            connection->snd_next_seq += bytes_sent;
+SPO_INLINE void spo_internal_write_packet_descs(spo_state_writer_t *writer, const spo_index_t *index)
+{
+    uint32_t i;
 
-            spo_internal_handle_next_data_sent(connection);
-        }
+    spo_internal_write_state(writer, &index->length, sizeof(index->length));
 
-        return bytes_sent;
+    for (i = 0; i < index->length; ++i)
+    {
+        spo_internal_write_state(writer, &index->items[i].start, sizeof(index->items[i].start));
+        spo_internal_write_state(writer, &index->items[i].size, sizeof(index->items[i].size));
     }
-
-    return 0;
 }
 
-SPO_INLINE uint32_t spo_internal_transmit_packet(spo_connection_data_t *connection, uint32_t seq)
+SPO_INLINE void spo_internal_write_received_ranges(spo_state_writer_t *writer, const spo_connection_data_t *connection)
 {
-    uint32_t pos_in_buf = seq - connection->snd_start_seq;
+    uint32_t count = 0;
+    uint32_t position = 0;
+    spo_packet_desc_t range;
 
-    if (pos_in_buf < connection->snd_buf_bytes)
+    while (spo_internal_next_received_range(connection, &position, &range))
+        ++count;
+
+    spo_internal_write_state(writer, &count, sizeof(count));
+
+    position = 0;
+    while (spo_internal_next_received_range(connection, &position, &range))
     {
-        /* send specified data packet */
-        uint32_t bytes_sent = spo_internal_send_data_packets(connection, seq, 1,
-            connection->snd_buf + pos_in_buf, connection->snd_buf_bytes - pos_in_buf);
+        spo_internal_write_state(writer, &range.start, sizeof(range.start));
+        spo_internal_write_state(writer, &range.size, sizeof(range.size));
+    }
+}
 
-        if (bytes_sent > 0)
-        {
-            /* 'snd_next_seq' always points to the next seq to send */
-            if (SPO_WRAPPED_LESS(connection->snd_next_seq, seq + bytes_sent))
-                connection->snd_next_seq = seq + bytes_sent;
+SPO_INLINE void spo_internal_export_connection(spo_state_writer_t *writer, spo_connection_data_t *connection)
+{
+    uint32_t position = 0;
+    uint32_t offset;
+    uint32_t size;
+    spo_packet_desc_t range;
+    uint32_t address_type = connection->remote_address.type;
 
-            return bytes_sent;
-        }
+    spo_internal_write_state(writer, &connection->local_port, sizeof(connection->local_port));
+    spo_internal_write_state(writer, &connection->remote_port, sizeof(connection->remote_port));
+    spo_internal_write_state(writer, &address_type, sizeof(address_type));
+    spo_internal_write_state(writer, connection->remote_address.address, sizeof(connection->remote_address.address));
+    spo_internal_write_state(writer, &connection->remote_address.port, sizeof(connection->remote_address.port));
+
+    /* sender */
+    spo_internal_write_state(writer, &connection->snd_start_seq, sizeof(connection->snd_start_seq));
+    spo_internal_write_state(writer, &connection->snd_next_seq, sizeof(connection->snd_next_seq));
+    spo_internal_write_state(writer, &connection->snd_buf_bytes, sizeof(connection->snd_buf_bytes));
+    spo_internal_write_state(writer, &connection->snd_cwnd_bytes, sizeof(connection->snd_cwnd_bytes));
+    spo_internal_write_state(writer, &connection->snd_ssthresh_bytes, sizeof(connection->snd_ssthresh_bytes));
+    spo_internal_write_state(writer, &connection->snd_retransmit_next_seq, sizeof(connection->snd_retransmit_next_seq));
+    spo_internal_write_state(writer, &connection->snd_recovery_point_seq, sizeof(connection->snd_recovery_point_seq));
+    spo_internal_write_state(writer, &connection->snd_retransmit_rescue_seq, sizeof(connection->snd_retransmit_rescue_seq));
+    spo_internal_write_state(writer, &connection->snd_last_data_sent_time, sizeof(connection->snd_last_data_sent_time));
+    spo_internal_write_state(writer, &connection->snd_last_packet_time, sizeof(connection->snd_last_packet_time));
+    spo_internal_write_state(writer, &connection->snd_duplicate_acks, sizeof(connection->snd_duplicate_acks));
+    spo_internal_write_state(writer, &connection->snd_recovery_mode, sizeof(connection->snd_recovery_mode));
+    spo_internal_write_state(writer, &connection->snd_mandatory_packets, sizeof(connection->snd_mandatory_packets));
+    spo_internal_write_state(writer, &connection->snd_mandatory_packets_skipped,
+        sizeof(connection->snd_mandatory_packets_skipped));
+
+    /* receiver */
+    spo_internal_write_state(writer, &connection->rcv_start_seq, sizeof(connection->rcv_start_seq));
+    spo_internal_write_state(writer, &connection->rcv_bytes_ready, sizeof(connection->rcv_bytes_ready));
+    spo_internal_write_state(writer, &connection->rcv_last_packet_time, sizeof(connection->rcv_last_packet_time));
+    spo_internal_write_state(writer, &connection->rcv_last_data_time, sizeof(connection->rcv_last_data_time));
+    spo_internal_write_state(writer, &connection->cold.created_time, sizeof(connection->cold.created_time));
+
+    /* buffers and packets */
+    spo_internal_write_state_send_buffer(writer, connection);
+    spo_internal_write_state_rcv_buffer(writer, connection, 0, connection->rcv_bytes_ready);
+    spo_internal_write_packet_descs(writer, &connection->snd_acked_packets);
+    spo_internal_write_received_ranges(writer, connection);
+
+    while (spo_internal_next_received_range(connection, &position, &range))
+    {
+        offset = spo_internal_get_out_of_order_offset(connection, &range, &size);
+        spo_internal_write_state_rcv_buffer(writer, connection, offset, size);
     }
+}
 
-    return 0;
+/* only the established connections known to the user code are exported */
+SPO_INLINE spo_bool_t spo_internal_exportable_connection(spo_connection_data_t *connection)
+{
+    return connection->state == SPO_CONNECTION_STATE_CONNECTED && connection->cold.pool == NULL;
 }
 
-SPO_INLINE spo_bool_t spo_internal_process_established_connection(spo_connection_data_t *connection)
+SPO_INLINE uint32_t spo_internal_export_host(spo_host_data_t *host, uint8_t *buf, uint32_t buf_size)
 {
-    /* can't transmit data if send buffer is empty */
-    if (connection->snd_buf_bytes > 0 && spo_internal_handle_data_transmission(connection))
-        return SPO_TRUE;
+    spo_connection_data_t *connection;
+    spo_state_writer_t writer;
+    uint32_t magic = SPO_STATE_MAGIC;
+    uint32_t version = SPO_STATE_VERSION;
+    uint32_t connections_count = 0;
+    spo_list_item_t *current = SPO_LIST_FIRST(&host->connections);
 
-    /* can't send data, so send a special packet */
+    while (SPO_LIST_VALID(&host->connections, current))
+    {
+        if (spo_internal_exportable_connection((spo_connection_data_t *)current->data))
+            ++connections_count;
 
-    if (spo_internal_send_fast_ack(connection))
-        return SPO_TRUE;
+        current = SPO_LIST_NEXT(&host->connections, current);
+    }
 
-    if (spo_internal_send_ping_packet(connection))
-        return SPO_TRUE;
+    writer.data = buf;
+    writer.size = buf_size;
+    writer.position = 0;
 
-    return SPO_FALSE;
+    spo_internal_write_state(&writer, &magic, sizeof(magic));
+    spo_internal_write_state(&writer, &version, sizeof(version));
+    spo_internal_write_state(&writer, host->secret_key, sizeof(host->secret_key)); /* keeps the cookies valid */
+    spo_internal_write_state(&writer, &connections_count, sizeof(connections_count));
+
+    current = SPO_LIST_FIRST(&host->connections);
+    while (SPO_LIST_VALID(&host->connections, current))
+    {
+        connection = (spo_connection_data_t *)current->data;
+
+        if (spo_internal_exportable_connection(connection))
+            spo_internal_export_connection(&writer, connection);
+
+        current = SPO_LIST_NEXT(&host->connections, current);
+    }
+
+    if (buf != NULL && writer.position <= buf_size)
+        host->exported = SPO_TRUE;
+
+    return writer.position;
 }
 
-SPO_INLINE spo_bool_t spo_internal_process_started_connection(spo_connection_data_t *connection)
+/* the importing host can have smaller buffers, so the imported ranges are checked against them */
+SPO_INLINE spo_bool_t spo_internal_range_in_window(uint32_t win_start_seq, uint32_t win_size, uint32_t start, uint32_t size)
+{
+    uint32_t offset = start - win_start_seq;
+    return offset <= win_size && size <= win_size - offset;
+}
+
+SPO_INLINE spo_bool_t spo_internal_import_packet_descs(spo_state_reader_t *reader, spo_index_t *index,
+    uint32_t win_start_seq, uint32_t win_size)
 {
-    if (spo_time_elapsed(connection->snd_last_packet_time) >= connection->host->configuration.connect_retransmission_timeout)
+    uint32_t i;
+    uint32_t count;
+    uint32_t start;
+    uint32_t size;
+    spo_index_item_t *last_item = NULL;
+
+    if (!spo_internal_read_state(reader, &count, sizeof(count)))
+        return SPO_FALSE;
+
+    for (i = 0; i < count; ++i)
     {
-        if (connection->connect_attempts < connection->host->configuration.max_connect_attempts)
-        {
-            spo_internal_send_packet(connection, SPO_PACKET_CONNECT, connection->snd_start_seq, NULL, 0);
-            ++connection->connect_attempts;
+        if (!spo_internal_read_state(reader, &start, sizeof(start)) ||
+            !spo_internal_read_state(reader, &size, sizeof(size)))
+            return SPO_FALSE;
 
-            SPO_LOG("CONNECT sent");
-        }
-        else
-        {
-            spo_internal_terminate_connection(connection);
-        }
+        if (!spo_internal_range_in_window(win_start_seq, win_size, start, size))
+            return SPO_FALSE;
 
-        return SPO_TRUE;
+        last_item = spo_index_insert_item_after(index, last_item, start, size);
+        if (last_item == NULL)
+            return SPO_FALSE;
     }
 
-    return SPO_FALSE;
+    return SPO_TRUE;
 }
 
-SPO_INLINE spo_bool_t spo_internal_process_incoming_connection(spo_connection_data_t *connection)
+SPO_INLINE spo_bool_t spo_internal_import_received_ranges(spo_state_reader_t *reader, spo_connection_data_t *connection)
 {
-    if (spo_time_elapsed(connection->snd_last_packet_time) >= connection->host->configuration.accept_retransmission_timeout)
+    uint32_t i;
+    uint32_t count;
+    uint32_t start;
+    uint32_t size;
+
+    if (!spo_internal_read_state(reader, &count, sizeof(count)))
+        return SPO_FALSE;
+
+    for (i = 0; i < count; ++i)
     {
-        if (connection->connect_attempts < connection->host->configuration.max_accepted_attempts)
-        {
-            spo_internal_send_packet(connection, SPO_PACKET_ACCEPT, connection->snd_start_seq, NULL, 0);
-            ++connection->connect_attempts;
+        if (!spo_internal_read_state(reader, &start, sizeof(start)) ||
+            !spo_internal_read_state(reader, &size, sizeof(size)))
+            return SPO_FALSE;
 
-            SPO_LOG("ACCEPTED sent");
-        }
-        else
-        {
-            spo_internal_terminate_connection(connection);
-        }
+        if (!spo_internal_range_in_window(connection->rcv_start_seq, connection->parameters.buf_size, start, size) ||
+            !spo_internal_save_received_data(connection, start, size))
+            return SPO_FALSE;
+    }
+
+    return SPO_TRUE;
+}
 
+SPO_INLINE spo_bool_t spo_internal_import_buffer(spo_state_reader_t *reader, spo_connection_data_t *connection,
+    spo_segment_chain_t *chain, uint32_t offset, uint32_t size)
+{
+    const uint8_t *data = spo_internal_read_state_buffer(reader, size);
+
+    if (data == NULL)
+        return SPO_FALSE;
+    if (size == 0)
         return SPO_TRUE;
-    }
 
-    return SPO_FALSE;
+    /* the data were accepted already, so the reserve can be used */
+    return spo_segment_chain_write(chain, &connection->host->segments_pool, offset, data, size, SPO_TRUE) == size;
 }
 
-SPO_INLINE spo_bool_t spo_internal_process_connections(spo_host_data_t *host)
+SPO_INLINE spo_bool_t spo_internal_import_connection_data(spo_state_reader_t *reader, spo_connection_data_t *connection)
 {
-    spo_bool_t state_changed = SPO_FALSE;
-    spo_connection_data_t *connection;
-    spo_list_item_t *current = SPO_LIST_FIRST(&host->connections);
+    uint32_t position = 0;
+    uint32_t offset;
+    uint32_t size;
+    spo_packet_desc_t range;
 
-    while (SPO_LIST_VALID(&host->connections, current))
-    {
-        connection = (spo_connection_data_t *)current->data;
+    /* sender */
+    if (!spo_internal_read_state(reader, &connection->snd_start_seq, sizeof(connection->snd_start_seq)) ||
+        !spo_internal_read_state(reader, &connection->snd_next_seq, sizeof(connection->snd_next_seq)) ||
+        !spo_internal_read_state(reader, &connection->snd_buf_bytes, sizeof(connection->snd_buf_bytes)) ||
+        !spo_internal_read_state(reader, &connection->snd_cwnd_bytes, sizeof(connection->snd_cwnd_bytes)) ||
+        !spo_internal_read_state(reader, &connection->snd_ssthresh_bytes, sizeof(connection->snd_ssthresh_bytes)) ||
+        !spo_internal_read_state(reader, &connection->snd_retransmit_next_seq, sizeof(connection->snd_retransmit_next_seq)) ||
+        !spo_internal_read_state(reader, &connection->snd_recovery_point_seq, sizeof(connection->snd_recovery_point_seq)) ||
+        !spo_internal_read_state(reader, &connection->snd_retransmit_rescue_seq, sizeof(connection->snd_retransmit_rescue_seq)) ||
+        !spo_internal_read_state(reader, &connection->snd_last_data_sent_time, sizeof(connection->snd_last_data_sent_time)) ||
+        !spo_internal_read_state(reader, &connection->snd_last_packet_time, sizeof(connection->snd_last_packet_time)) ||
+        !spo_internal_read_state(reader, &connection->snd_duplicate_acks, sizeof(connection->snd_duplicate_acks)) ||
+        !spo_internal_read_state(reader, &connection->snd_recovery_mode, sizeof(connection->snd_recovery_mode)) ||
+        !spo_internal_read_state(reader, &connection->snd_mandatory_packets, sizeof(connection->snd_mandatory_packets)) ||
+        !spo_internal_read_state(reader, &connection->snd_mandatory_packets_skipped,
+            sizeof(connection->snd_mandatory_packets_skipped)))
+        return SPO_FALSE;
 
-        switch (connection->state)
-        {
-        case SPO_CONNECTION_STATE_CONNECT_STARTED:
-            if (spo_internal_process_started_connection(connection))
-                state_changed = SPO_TRUE;
-            break;
-        case SPO_CONNECTION_STATE_CONNECT_RECEIVED_WHILE_STARTED:
-        case SPO_CONNECTION_STATE_CONNECT_RECEIVED:
-            if (spo_internal_process_incoming_connection(connection))
-                state_changed = SPO_TRUE;
-            break;
-        case SPO_CONNECTION_STATE_CONNECTED:
-            if (spo_internal_check_connection_timeout(connection))
-            {
-                state_changed = SPO_TRUE;
-                break;
-            }
+    if (connection->snd_buf_bytes > connection->parameters.buf_size ||
+        connection->snd_next_seq - connection->snd_start_seq > connection->snd_buf_bytes)
+        return SPO_FALSE;
+
+    /* receiver */
+    if (!spo_internal_read_state(reader, &connection->rcv_start_seq, sizeof(connection->rcv_start_seq)) ||
+        !spo_internal_read_state(reader, &connection->rcv_bytes_ready, sizeof(connection->rcv_bytes_ready)) ||
+        !spo_internal_read_state(reader, &connection->rcv_last_packet_time, sizeof(connection->rcv_last_packet_time)) ||
+        !spo_internal_read_state(reader, &connection->rcv_last_data_time, sizeof(connection->rcv_last_data_time)) ||
+        !spo_internal_read_state(reader, &connection->cold.created_time, sizeof(connection->cold.created_time)))
+        return SPO_FALSE;
 
-            if (spo_internal_check_received_data(connection))
-                state_changed = SPO_TRUE;
-            if (spo_internal_process_established_connection(connection))
-                state_changed = SPO_TRUE;
-            break;
-        }
+    if (connection->rcv_bytes_ready > connection->parameters.buf_size)
+        return SPO_FALSE;
 
-        /* remove terminated connections from the list */
-        if (connection->state == SPO_CONNECTION_STATE_CLOSED)
-            current = spo_list_remove_item(&host->connections, current);
-        else
-            current = SPO_LIST_NEXT(&host->connections, current);
+    /* buffers and packets */
+    if (!spo_internal_import_buffer(reader, connection, &connection->snd_buf, 0, connection->snd_buf_bytes) ||
+        !spo_internal_import_buffer(reader, connection, &connection->rcv_buf, 0, connection->rcv_bytes_ready) ||
+        !spo_internal_import_packet_descs(reader, &connection->snd_acked_packets,
+            connection->snd_start_seq, connection->snd_buf_bytes) ||
+        !spo_internal_import_received_ranges(reader, connection))
+        return SPO_FALSE;
+
+    while (spo_internal_next_received_range(connection, &position, &range))
+    {
+        offset = spo_internal_get_out_of_order_offset(connection, &range, &size);
+        if (!spo_internal_import_buffer(reader, connection, &connection->rcv_buf, offset, size))
+            return SPO_FALSE;
     }
 
-    return state_changed;
+    /* lost ranges aren't a part of the state, they are found from the acks list */
+    if (connection->snd_recovery_mode != SPO_RECOVERY_OFF)
+        spo_internal_rebuild_lost_ranges(connection);
+
+    return SPO_TRUE;
 }
 
-SPO_INLINE spo_bool_t spo_internal_receive_packets(spo_host_data_t *host)
+SPO_INLINE spo_bool_t spo_internal_import_connection(spo_state_reader_t *reader, spo_host_data_t *host)
 {
-    uint8_t packet_data[SPO_NET_MAX_PACKET_SIZE];
-    spo_net_address_t address;
-    uint32_t bytes_received;
-    spo_bool_t data_received = SPO_FALSE;
-    spo_bool_t data_available = spo_net_data_available(host->socket);
-    while (data_available)
-    {
-        bytes_received = spo_net_recv(host->socket, packet_data, sizeof(packet_data), &address);
-        if (bytes_received > 0)
-        {
-            spo_internal_process_packet(host, &address, packet_data, bytes_received);
-            data_received = SPO_TRUE;
-        }
+    uint16_t local_port;
+    uint16_t remote_port;
+    uint32_t address_type;
+    spo_net_address_t remote_address;
+    spo_connection_data_t *connection;
 
-        data_available = spo_net_data_available(host->socket);
-    }
+    memset(&remote_address, 0, sizeof(remote_address));
 
-    return data_received;
-}
+    if (!spo_internal_read_state(reader, &local_port, sizeof(local_port)) ||
+        !spo_internal_read_state(reader, &remote_port, sizeof(remote_port)) ||
+        !spo_internal_read_state(reader, &address_type, sizeof(address_type)) ||
+        !spo_internal_read_state(reader, remote_address.address, sizeof(remote_address.address)) ||
+        !spo_internal_read_state(reader, &remote_address.port, sizeof(remote_address.port)))
+        return SPO_FALSE;
 
-SPO_INLINE spo_connection_data_t *spo_internal_start_connection(spo_host_data_t *host, const spo_net_address_t *remote_address)
-{
-    spo_connection_data_t *connection = spo_internal_allocate_connection(host);
+    remote_address.type = (spo_net_socket_type_t)address_type;
+
+    /* the peer knows the connection by its port, so the port can't be changed */
+    if (local_port == 0 || local_port == UINT16_MAX || host->connections_by_ports[local_port] != NULL ||
+        host->connections.length >= host->configuration.max_connections)
+        return SPO_FALSE;
+
+    connection = spo_internal_create_connection(host, local_port);
     if (connection == NULL)
-        return NULL;
+        return SPO_FALSE;
 
-    /* add connection to 'started_connections' list */
-    if (spo_list_add_item(&host->started_connections, connection) == NULL)
+    connection->remote_port = remote_port;
+    connection->remote_address = remote_address;
+
+    if (!spo_internal_import_connection_data(reader, connection))
     {
+        /* the connection is still in INIT state, so it's released without any events */
         spo_internal_terminate_connection(connection);
-        return NULL;
+        return SPO_FALSE;
     }
 
-    SPO_LOG("CONNECT started");
+    /* no handshake, the connection continues right where it was */
+    connection->state = SPO_CONNECTION_STATE_CONNECTED;
+    spo_internal_wake_connection(connection);
+    return SPO_TRUE;
+}
 
-    connection->state = SPO_CONNECTION_STATE_CONNECT_STARTED;
-    connection->remote_address = *remote_address;
+SPO_INLINE spo_bool_t spo_internal_import_host(spo_host_data_t *host, const uint8_t *buf, uint32_t buf_size)
+{
+    uint32_t i;
+    uint32_t magic;
+    uint32_t version;
+    uint32_t connections_count;
+    spo_state_reader_t reader;
+
+    reader.data = buf;
+    reader.size = buf_size;
+    reader.position = 0;
+
+    if (!spo_internal_read_state(&reader, &magic, sizeof(magic)) || magic != SPO_STATE_MAGIC ||
+        !spo_internal_read_state(&reader, &version, sizeof(version)) || version != SPO_STATE_VERSION ||
+        !spo_internal_read_state(&reader, host->secret_key, sizeof(host->secret_key)) ||
+        !spo_internal_read_state(&reader, &connections_count, sizeof(connections_count)))
+        return SPO_FALSE;
 
-    return connection;
+    spo_internal_update_time(host);
+
+    for (i = 0; i < connections_count; ++i)
+    {
+        if (!spo_internal_import_connection(&reader, host))
+            return SPO_FALSE;
+    }
+
+    return SPO_TRUE;
 }
 
 spo_bool_t spo_init()
@@ -1873,6 +3812,7 @@ spo_bool_t spo_init()
     spo_allowed_packets[SPO_CONNECTION_STATE_CONNECTED][SPO_PACKET_ACK]   = SPO_TRUE;
     spo_allowed_packets[SPO_CONNECTION_STATE_CONNECTED][SPO_PACKET_PING]  = SPO_TRUE;
     spo_allowed_packets[SPO_CONNECTION_STATE_CONNECTED][SPO_PACKET_DATA]  = SPO_TRUE;
+    spo_allowed_packets[SPO_CONNECTION_STATE_CONNECTED][SPO_PACKET_CHALLENGE] = SPO_TRUE;
 
     return SPO_TRUE;
 }
@@ -1887,45 +3827,279 @@ void spo_set_logger(logger_ptr_t logger)
     spo_logger = logger;
 }
 
-spo_host_t spo_new_host(const spo_net_address_t *bind_address,
-    const spo_configuration *configuration, const spo_callbacks_t *callbacks)
+void spo_set_allocator(const spo_allocator_t *allocator)
 {
-    spo_net_socket_t socket;
+    if (allocator != NULL)
+        spo_allocator = *allocator;
+    else
+        memset(&spo_allocator, 0, sizeof(spo_allocator));
+}
+
+/* the caller creates the socket of the host */
+SPO_INLINE spo_host_data_t *spo_internal_new_host(const spo_configuration *configuration, const spo_callbacks_t *callbacks)
+{
+    spo_memory_t memory;
     spo_host_data_t *host_data;
 
-    socket = spo_net_new_socket(bind_address, configuration->socket_buf_size);
-    if (socket == NULL)
-        return NULL;
+    spo_memory_init(&memory, &spo_allocator);
 
-    host_data = (spo_host_data_t *)malloc(sizeof(spo_host_data_t));
+    host_data = (spo_host_data_t *)spo_memory_alloc(&memory, sizeof(spo_host_data_t));
     if (host_data == NULL)
-    {
-        spo_net_close_socket(socket);
         return NULL;
-    }
 
-    host_data->socket = socket;
+    host_data->memory = memory;
+    host_data->socket = NULL;
     host_data->configuration = *configuration;
     host_data->callbacks = *callbacks;
-    spo_list_init(&host_data->connections);
-    spo_list_init(&host_data->started_connections);
-    spo_list_init(&host_data->incoming_connections);
+    spo_slab_init(&host_data->connections_slab, &host_data->memory,
+        sizeof(spo_connection_data_t), SPO_CACHE_LINE_SIZE, SPO_SLAB_CHUNK_ITEMS);
+    spo_slab_init(&host_data->list_items_slab, &host_data->memory,
+        sizeof(spo_list_item_t), sizeof(void *), SPO_SLAB_CHUNK_ITEMS);
+    spo_slab_init(&host_data->send_buffers_slab, &host_data->memory,
+        sizeof(spo_send_buffer_t), sizeof(void *), SPO_SLAB_CHUNK_ITEMS);
+    spo_slab_init(&host_data->receive_buffers_slab, &host_data->memory,
+        sizeof(spo_receive_buffer_t), sizeof(void *), SPO_SLAB_CHUNK_ITEMS);
+    spo_segment_pool_init(&host_data->segments_pool, &host_data->memory,
+        configuration->buffers_memory_limit, configuration->use_hugepages ? SPO_TRUE : SPO_FALSE);
+    spo_random_fill(host_data->secret_key, sizeof(host_data->secret_key));
+    host_data->cookie_sent_time = 0;
+    host_data->packets_sent = 0;
+    host_data->exported = SPO_FALSE;
+    memset(&host_data->statistics, 0, sizeof(host_data->statistics));
+    host_data->source_limits = NULL;
+    spo_list_init(&host_data->connections, &host_data->list_items_slab);
+    spo_list_init(&host_data->started_connections, &host_data->list_items_slab);
+    spo_list_init(&host_data->incoming_connections, &host_data->list_items_slab);
+    spo_list_init(&host_data->pools, &host_data->list_items_slab);
     memset(host_data->connections_by_ports, 0, sizeof(host_data->connections_by_ports));
+    host_data->time = 0;
+    spo_internal_update_time(host_data);
+
+    /* live connections never exceed 'max_connections', so the timers are allocated once */
+    host_data->timers.count = 0;
+    host_data->timers.next_slot = 0;
+    host_data->timers.size = SPO_MAX(configuration->max_connections, 1);
+    host_data->timers.deadlines = (spo_time_t *)spo_memory_alloc(&host_data->memory,
+        host_data->timers.size * sizeof(spo_time_t));
+    host_data->timers.connections = (spo_connection_data_t **)spo_memory_alloc(&host_data->memory,
+        host_data->timers.size * sizeof(spo_connection_data_t *));
+
+    if (host_data->timers.deadlines == NULL || host_data->timers.connections == NULL)
+    {
+        spo_close_host(host_data);
+        return NULL;
+    }
+
+    spo_internal_init_token_bucket(host_data, &host_data->resets_limit, configuration->max_resets_per_second);
+    host_data->connect_pacer_time = 0;
+    host_data->connects_in_flight = 0;
+    if (configuration->max_resets_per_source > 0 || configuration->max_connects_per_source > 0)
+    {
+        host_data->source_limits = (spo_source_limits_t *)spo_memory_alloc(&host_data->memory,
+            SPO_SOURCE_LIMITS_SIZE * sizeof(spo_source_limits_t));
+        if (host_data->source_limits == NULL)
+        {
+            spo_close_host(host_data);
+            return NULL;
+        }
+
+        memset(host_data->source_limits, 0, SPO_SOURCE_LIMITS_SIZE * sizeof(spo_source_limits_t));
+    }
+
+    if (configuration->preallocate_connections && spo_internal_preallocate_pools(host_data) == SPO_FALSE)
+    {
+        spo_close_host(host_data);
+        return NULL;
+    }
+
+    return host_data;
+}
+
+spo_host_t spo_new_host(const spo_net_address_t *bind_address,
+    const spo_configuration *configuration, const spo_callbacks_t *callbacks)
+{
+    spo_host_data_t *host_data = spo_internal_new_host(configuration, callbacks);
+    if (host_data == NULL)
+        return NULL;
+
+    host_data->socket = spo_net_new_socket(bind_address, configuration->socket_buf_size, &host_data->memory);
+    if (host_data->socket == NULL)
+    {
+        spo_close_host(host_data);
+        return NULL;
+    }
 
     return host_data;
 }
 
 void spo_close_host(spo_host_t host)
 {
+    spo_memory_t memory;
+    spo_pool_data_t *pool_data;
+    spo_connection_data_t *connection_data;
     spo_host_data_t *host_data = (spo_host_data_t *)host;
 
-    /* TODO: terminate and remove all connections */
-    spo_net_close_socket(host_data->socket);
+    spo_list_item_t *current = SPO_LIST_FIRST(&host_data->connections);
+
+    /* the other sides don't wait for the connections timeout */
+    while (SPO_LIST_VALID(&host_data->connections, current))
+    {
+        connection_data = (spo_connection_data_t *)current->data;
+        if (host_data->socket != NULL && connection_data->state != SPO_CONNECTION_STATE_CLOSED &&
+            !(host_data->exported && spo_internal_exportable_connection(connection_data)))
+        {
+            spo_internal_send_reset_packet(host_data,
+                &connection_data->remote_address,
+                connection_data->local_port,
+                connection_data->remote_port,
+                connection_data->snd_start_seq,
+                connection_data->rcv_start_seq);
+        }
+
+        spo_internal_destroy_connection(connection_data);
+        current = SPO_LIST_NEXT(&host_data->connections, current);
+    }
+
+    /* pooled connections are destroyed with the others */
+    current = SPO_LIST_FIRST(&host_data->pools);
+    while (SPO_LIST_VALID(&host_data->pools, current))
+    {
+        pool_data = (spo_pool_data_t *)current->data;
+        spo_list_destroy(&pool_data->connections);
+        spo_memory_free(&host_data->memory, pool_data, sizeof(spo_pool_data_t));
+
+        current = SPO_LIST_NEXT(&host_data->pools, current);
+    }
+
+    if (host_data->socket != NULL)
+        spo_net_close_socket(host_data->socket);
+    spo_list_destroy(&host_data->pools);
     spo_list_destroy(&host_data->connections);
     spo_list_destroy(&host_data->started_connections);
     spo_list_destroy(&host_data->incoming_connections);
 
-    free(host_data);
+    /* connections memory is released here, so all the connection handles become invalid */
+    spo_slab_destroy(&host_data->connections_slab);
+    spo_slab_destroy(&host_data->list_items_slab);
+    spo_slab_destroy(&host_data->send_buffers_slab);
+    spo_slab_destroy(&host_data->receive_buffers_slab);
+    spo_segment_pool_destroy(&host_data->segments_pool);
+
+    spo_memory_free(&host_data->memory, host_data->timers.deadlines, host_data->timers.size * sizeof(spo_time_t));
+    spo_memory_free(&host_data->memory, host_data->timers.connections,
+        host_data->timers.size * sizeof(spo_connection_data_t *));
+
+    if (host_data->source_limits != NULL)
+        spo_memory_free(&host_data->memory, host_data->source_limits, SPO_SOURCE_LIMITS_SIZE * sizeof(spo_source_limits_t));
+
+    memory = host_data->memory; /* the host can't release itself using its own data */
+    spo_memory_free(&memory, host_data, sizeof(spo_host_data_t));
+}
+
+uint32_t spo_export_host(spo_host_t host, uint8_t *buf, uint32_t buf_size)
+{
+    return spo_internal_export_host((spo_host_data_t *)host, buf, buf_size);
+}
+
+spo_bool_t spo_import_host(spo_host_t host, const uint8_t *buf, uint32_t buf_size)
+{
+    return spo_internal_import_host((spo_host_data_t *)host, buf, buf_size);
+}
+
+spo_bool_t spo_handoff_host(spo_host_t host, int unix_socket)
+{
+    spo_bool_t result;
+    uint8_t *state;
+    spo_host_data_t *host_data = (spo_host_data_t *)host;
+    uint32_t state_size = spo_internal_export_host(host_data, NULL, 0);
+
+    state = (uint8_t *)spo_memory_alloc(&host_data->memory, state_size);
+    if (state == NULL)
+        return SPO_FALSE;
+
+    spo_internal_export_host(host_data, state, state_size);
+    result = spo_net_send_socket(host_data->socket, unix_socket, state, state_size);
+    spo_memory_free(&host_data->memory, state, state_size);
+
+    /* the connections belong to the other process now, so they are released silently */
+    if (result)
+        spo_close_host(host);
+
+    return result;
+}
+
+spo_host_t spo_take_over_host(int unix_socket, const spo_configuration *configuration, const spo_callbacks_t *callbacks)
+{
+    uint8_t *state;
+    uint32_t state_size;
+    spo_bool_t imported;
+    spo_host_data_t *host_data = spo_internal_new_host(configuration, callbacks);
+    if (host_data == NULL)
+        return NULL;
+
+    host_data->socket = spo_net_receive_socket(unix_socket, &host_data->memory, &state, &state_size);
+    if (host_data->socket == NULL)
+    {
+        spo_close_host(host_data);
+        return NULL;
+    }
+
+    imported = spo_internal_import_host(host_data, state, state_size);
+    spo_memory_free(&host_data->memory, state, state_size);
+
+    if (!imported)
+    {
+        spo_close_host(host_data);
+        return NULL;
+    }
+
+    return host_data;
+}
+
+uint32_t spo_get_connections(spo_host_t host, spo_connection_t *connections, uint32_t max_count)
+{
+    uint32_t count = 0;
+    spo_host_data_t *host_data = (spo_host_data_t *)host;
+    spo_list_item_t *current = SPO_LIST_FIRST(&host_data->connections);
+
+    while (SPO_LIST_VALID(&host_data->connections, current))
+    {
+        if (spo_internal_exportable_connection((spo_connection_data_t *)current->data))
+        {
+            if (count < max_count)
+                connections[count] = current->data;
+            ++count;
+        }
+
+        current = SPO_LIST_NEXT(&host_data->connections, current);
+    }
+
+    return count;
+}
+
+void spo_get_host_statistics(spo_host_t host, spo_host_statistics_t *statistics)
+{
+    spo_host_data_t *host_data = (spo_host_data_t *)host;
+
+    statistics->allocations = host_data->memory.counters.allocations;
+    statistics->reallocations = host_data->memory.counters.reallocations;
+    statistics->deallocations = host_data->memory.counters.deallocations;
+    statistics->bytes_in_use = host_data->memory.counters.bytes_in_use;
+
+    statistics->buffers_bytes_allocated = (uint64_t)host_data->segments_pool.segments_allocated * SPO_SEGMENT_SIZE;
+    statistics->buffers_bytes_in_use = (uint64_t)host_data->segments_pool.segments_used * SPO_SEGMENT_SIZE;
+
+    statistics->connect_cookies_sent = host_data->statistics.connect_cookies_sent;
+    statistics->connect_cookies_accepted = host_data->statistics.connect_cookies_accepted;
+
+    statistics->resets_dropped = host_data->statistics.resets_dropped;
+    statistics->connects_dropped = host_data->statistics.connects_dropped;
+
+    statistics->migration_challenges_sent = host_data->statistics.migration_challenges_sent;
+    statistics->connections_migrated = host_data->statistics.connections_migrated;
+
+    statistics->data_bytes_retransmitted = host_data->statistics.data_bytes_retransmitted;
+    statistics->duplicate_bytes_received = host_data->statistics.duplicate_bytes_received;
 }
 
 spo_bool_t spo_make_progress(spo_host_t host)
@@ -1933,19 +4107,129 @@ spo_bool_t spo_make_progress(spo_host_t host)
     spo_bool_t result = SPO_FALSE;
     spo_host_data_t *host_data = (spo_host_data_t *)host;
 
-    if (spo_internal_receive_packets(host_data))
+    spo_internal_replenish_pools(host_data);
+
+    /* a single pass: the received packets, then the connections */
+    if (spo_internal_receive_packets(host_data, SPO_PROGRESS_MAX_PACKETS) > 0)
         result = SPO_TRUE;
-    if (spo_internal_process_connections(host_data))
+    if (spo_internal_process_connections(host_data, UINT32_MAX) > 0)
         result = SPO_TRUE;
 
     return result;
 }
 
+spo_bool_t spo_make_progress_budget(spo_host_t host, uint32_t max_packets, uint32_t max_usecs)
+{
+    spo_bool_t work_done = SPO_FALSE;
+
+    if (max_packets == 0)
+        max_packets = SPO_PROGRESS_MAX_PACKETS;
+
+    return spo_internal_make_progress((spo_host_data_t *)host, max_packets, max_usecs, &work_done);
+}
+
 spo_connection_t spo_new_connection(spo_host_t host, const spo_net_address_t *host_address)
 {
     return spo_internal_start_connection((spo_host_data_t *)host, host_address);
 }
 
+uint32_t spo_new_connections(spo_host_t host, const spo_net_address_t *host_addresses, uint32_t count,
+    spo_connection_t *connections)
+{
+    uint32_t i;
+    uint32_t connections_started = 0;
+
+    /* CONNECTs are not sent here, the pacer spreads them over the next progress steps */
+    for (i = 0; i < count; ++i)
+    {
+        connections[i] = spo_internal_start_connection((spo_host_data_t *)host, &host_addresses[i]);
+        if (connections[i] != NULL)
+            ++connections_started;
+    }
+
+    return connections_started;
+}
+
+spo_pool_t spo_new_pool(spo_host_t host, const spo_net_address_t *host_address, uint32_t size)
+{
+    spo_host_data_t *host_data = (spo_host_data_t *)host;
+    spo_pool_data_t *pool_data = (spo_pool_data_t *)spo_memory_alloc(&host_data->memory, sizeof(spo_pool_data_t));
+    if (pool_data == NULL)
+        return NULL;
+
+    pool_data->host = host_data;
+    pool_data->address = *host_address;
+    pool_data->size = size;
+    spo_list_init(&pool_data->connections, &host_data->list_items_slab);
+
+    pool_data->list_item = spo_list_add_item(&host_data->pools, pool_data);
+    if (pool_data->list_item == NULL)
+    {
+        spo_memory_free(&host_data->memory, pool_data, sizeof(spo_pool_data_t));
+        return NULL;
+    }
+
+    /* connections are started by the next progress step */
+    return pool_data;
+}
+
+void spo_close_pool(spo_pool_t pool)
+{
+    spo_pool_data_t *pool_data = (spo_pool_data_t *)pool;
+    spo_host_data_t *host_data = pool_data->host;
+    spo_list_item_t *current = SPO_LIST_FIRST(&pool_data->connections);
+
+    while (SPO_LIST_VALID(&pool_data->connections, current))
+    {
+        spo_close_connection(current->data);
+        current = SPO_LIST_NEXT(&pool_data->connections, current);
+    }
+
+    spo_list_destroy(&pool_data->connections);
+    spo_list_remove_item(&host_data->pools, pool_data->list_item);
+    spo_memory_free(&host_data->memory, pool_data, sizeof(spo_pool_data_t));
+}
+
+spo_connection_t spo_checkout_connection(spo_pool_t pool)
+{
+    spo_connection_data_t *connection;
+    spo_pool_data_t *pool_data = (spo_pool_data_t *)pool;
+    spo_list_item_t *current = SPO_LIST_FIRST(&pool_data->connections);
+
+    while (SPO_LIST_VALID(&pool_data->connections, current))
+    {
+        connection = (spo_connection_data_t *)current->data;
+
+        if (connection->state == SPO_CONNECTION_STATE_CONNECTED)
+        {
+            spo_list_remove_item(&pool_data->connections, current);
+            connection->cold.pool = NULL;
+            return connection;
+        }
+
+        current = SPO_LIST_NEXT(&pool_data->connections, current);
+    }
+
+    return NULL;
+}
+
+void spo_checkin_connection(spo_pool_t pool, spo_connection_t connection)
+{
+    spo_pool_data_t *pool_data = (spo_pool_data_t *)pool;
+    spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+
+    /* only healthy connections are kept, the pool starts new ones instead of the others */
+    if (connection_data->state == SPO_CONNECTION_STATE_CONNECTED &&
+        pool_data->connections.length < pool_data->size &&
+        spo_list_add_item(&pool_data->connections, connection_data) != NULL)
+    {
+        connection_data->cold.pool = pool_data;
+        return;
+    }
+
+    spo_close_connection(connection);
+}
+
 spo_connection_state_t spo_get_connection_state(spo_connection_t connection)
 {
     spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
@@ -1981,25 +4265,102 @@ void spo_close_connection(spo_connection_t connection)
             connection_data->rcv_start_seq);
     }
 
+    spo_internal_detach_connection(connection_data);
+    if (connection_data->state == SPO_CONNECTION_STATE_CONNECT_STARTED)
+        spo_internal_leave_started_state(connection_data);
     spo_internal_destroy_connection(connection_data);
-    spo_list_remove_items_by_data(&connection_data->host->connections, connection_data);
-    spo_list_remove_items_by_data(&connection_data->host->started_connections, connection_data);
     /* don't try to remove the connection from 'incoming_connections' list as if the user code
        knows about connection then there is nothing to remove */
 
-    free(connection_data);
+    spo_slab_free(&connection_data->host->connections_slab, connection_data);
 }
 
 uint32_t spo_send(spo_connection_t connection, const uint8_t *buf, uint32_t buf_size)
 {
     spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+    uint32_t bytes_accepted = spo_internal_send_data(connection_data, buf, buf_size);
+
+    if (bytes_accepted > 0)
+        spo_internal_wake_connection(connection_data);
+
+    return bytes_accepted;
+}
+
+uint32_t spo_send_zc(spo_connection_t connection, const uint8_t *buf, uint32_t buf_size,
+    spo_send_completion_t completion, void *context)
+{
+    spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+    uint32_t bytes_accepted = spo_internal_send_user_data(connection_data, buf, buf_size, completion, context);
+
+    if (bytes_accepted > 0)
+        spo_internal_wake_connection(connection_data);
 
-    return spo_internal_send_data(connection_data, buf, buf_size);
+    return bytes_accepted;
 }
 
 uint32_t spo_read(spo_connection_t connection, uint8_t *buf, uint32_t buf_size)
 {
     spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+    uint32_t bytes_read = spo_internal_read_data(connection_data, buf, buf_size);
+
+    /* the posted buffer may get the ready data now */
+    if (bytes_read > 0 && connection_data->rcv_posted_buffers != NULL)
+        spo_internal_wake_connection(connection_data);
+
+    return bytes_read;
+}
+
+uint32_t spo_peek(spo_connection_t connection, spo_buffer_t *spans, uint32_t max_spans)
+{
+    spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+
+    return spo_internal_peek_data(connection_data, spans, max_spans);
+}
+
+uint32_t spo_consume(spo_connection_t connection, uint32_t size)
+{
+    spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+
+    uint32_t bytes_consumed = spo_internal_consume_data(connection_data, size);
+
+    if (bytes_consumed > 0 && connection_data->rcv_posted_buffers != NULL)
+        spo_internal_wake_connection(connection_data);
+
+    return bytes_consumed;
+}
+
+uint32_t spo_sendv(spo_connection_t connection, const spo_buffer_t *buffers, uint32_t count)
+{
+    spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+    uint32_t bytes_accepted = spo_internal_send_data_vector(connection_data, buffers, count);
 
-    return spo_internal_read_data(connection_data, buf, buf_size);
+    if (bytes_accepted > 0)
+        spo_internal_wake_connection(connection_data);
+
+    return bytes_accepted;
+}
+
+uint32_t spo_readv(spo_connection_t connection, const spo_buffer_t *buffers, uint32_t count)
+{
+    spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+
+    uint32_t bytes_read = spo_internal_read_data_vector(connection_data, buffers, count);
+
+    if (bytes_read > 0 && connection_data->rcv_posted_buffers != NULL)
+        spo_internal_wake_connection(connection_data);
+
+    return bytes_read;
+}
+
+spo_bool_t spo_post_receive(spo_connection_t connection, uint8_t *buf, uint32_t buf_size,
+    spo_receive_completion_t completion, void *context)
+{
+    spo_connection_data_t *connection_data = (spo_connection_data_t *)connection;
+
+    if (spo_internal_post_receive_buffer(connection_data, buf, buf_size, completion, context) == SPO_FALSE)
+        return SPO_FALSE;
+
+    /* the buffer may be filled by the data received already */
+    spo_internal_wake_connection(connection_data);
+    return SPO_TRUE;
 }
@@ -0,0 +1,343 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <string.h>
+#include "segment.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#define SPO_SEGMENTS_PER_CHUNK 16
+#define SPO_HUGEPAGE_SIZE (2 * 1024 * 1024)
+#define SPO_SEGMENT_CHAIN_MIN_SIZE 4
+
+/* segment of the stream by its index from the head */
+#define SPO_SEGMENT_CHAIN_AT(chain, index) ((chain)->segments[((chain)->head + (index)) & ((chain)->size - 1)])
+
+SPO_INLINE spo_segment_chunk_t *spo_internal_map_hugepages(size_t size)
+{
+#if !defined(_WIN32) && defined(MAP_HUGETLB)
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (memory != MAP_FAILED)
+        return (spo_segment_chunk_t *)memory;
+#endif
+
+    /* hugepages are not supported or not configured in the system */
+    return NULL;
+}
+
+SPO_INLINE spo_bool_t spo_internal_add_segment_chunk(spo_segment_pool_t *pool)
+{
+    uint32_t i;
+    uint32_t segments;
+    uint8_t *segment;
+    spo_segment_chunk_t *chunk = NULL;
+
+    if (pool->use_hugepages)
+    {
+        /* the first segment is occupied by the chunk header, so the others are page aligned */
+        chunk = spo_internal_map_hugepages(SPO_HUGEPAGE_SIZE);
+        if (chunk != NULL)
+        {
+            chunk->size = SPO_HUGEPAGE_SIZE;
+            chunk->huge = SPO_TRUE;
+            segment = (uint8_t *)chunk + SPO_SEGMENT_SIZE;
+            segments = SPO_HUGEPAGE_SIZE / SPO_SEGMENT_SIZE - 1;
+        }
+    }
+
+    if (chunk == NULL)
+    {
+        size_t size = sizeof(spo_segment_chunk_t) + SPO_CACHE_LINE_SIZE - 1 +
+            (size_t)SPO_SEGMENTS_PER_CHUNK * SPO_SEGMENT_SIZE;
+
+        chunk = (spo_segment_chunk_t *)spo_memory_alloc(pool->memory, size);
+        if (chunk == NULL)
+            return SPO_FALSE;
+
+        chunk->size = size;
+        chunk->huge = SPO_FALSE;
+        segment = (uint8_t *)(chunk + 1);
+        segment += (SPO_CACHE_LINE_SIZE - (size_t)segment % SPO_CACHE_LINE_SIZE) % SPO_CACHE_LINE_SIZE;
+        segments = SPO_SEGMENTS_PER_CHUNK;
+    }
+
+    chunk->next_chunk = pool->chunks;
+    pool->chunks = chunk;
+
+    /* push new segments to the free list */
+    for (i = 0; i < segments; ++i)
+    {
+        *(void **)segment = pool->free_segments;
+        pool->free_segments = segment;
+        segment += SPO_SEGMENT_SIZE;
+    }
+
+    pool->segments_allocated += segments;
+    return SPO_TRUE;
+}
+
+void spo_segment_pool_init(spo_segment_pool_t *pool, spo_memory_t *memory, uint64_t max_bytes, spo_bool_t use_hugepages)
+{
+    uint64_t max_segments = max_bytes / SPO_SEGMENT_SIZE;
+
+    pool->memory = memory;
+    pool->free_segments = NULL;
+    pool->chunks = NULL;
+    pool->segments_allocated = 0;
+    pool->segments_used = 0;
+    pool->max_segments = (max_segments > UINT32_MAX) ? UINT32_MAX : (uint32_t)max_segments;
+    if (max_bytes > 0 && pool->max_segments == 0)
+        pool->max_segments = 1;
+    pool->reserved_segments = pool->max_segments / 8;
+    pool->use_hugepages = use_hugepages;
+}
+
+void spo_segment_pool_destroy(spo_segment_pool_t *pool)
+{
+    spo_segment_chunk_t *next;
+    spo_segment_chunk_t *current = pool->chunks;
+
+    while (current != NULL)
+    {
+        next = current->next_chunk;
+
+#ifndef _WIN32
+        if (current->huge)
+            munmap(current, current->size);
+        else
+#endif
+            spo_memory_free(pool->memory, current, current->size);
+
+        current = next;
+    }
+
+    pool->free_segments = NULL;
+    pool->chunks = NULL;
+    pool->segments_allocated = 0;
+    pool->segments_used = 0;
+}
+
+uint8_t *spo_segment_alloc(spo_segment_pool_t *pool, spo_bool_t use_reserve)
+{
+    uint8_t *segment;
+
+    if (pool->max_segments > 0)
+    {
+        uint32_t limit = use_reserve ? pool->max_segments : pool->max_segments - pool->reserved_segments;
+        if (pool->segments_used >= limit)
+            return NULL; /* memory budget is exhausted */
+    }
+
+    if (pool->free_segments == NULL)
+    {
+        if (spo_internal_add_segment_chunk(pool) == SPO_FALSE)
+            return NULL;
+    }
+
+    segment = (uint8_t *)pool->free_segments;
+    pool->free_segments = *(void **)segment;
+
+    ++pool->segments_used;
+    return segment;
+}
+
+void spo_segment_free(spo_segment_pool_t *pool, uint8_t *segment)
+{
+    *(void **)segment = pool->free_segments;
+    pool->free_segments = segment;
+
+    --pool->segments_used;
+}
+
+/* segment chains */
+
+SPO_INLINE spo_bool_t spo_internal_extend_segment_chain(spo_segment_chain_t *chain, spo_segment_pool_t *pool, uint32_t count)
+{
+    uint32_t i;
+
+    if (count > chain->size)
+    {
+        uint32_t new_size = SPO_MAX(chain->size, SPO_SEGMENT_CHAIN_MIN_SIZE);
+        uint32_t head_segments = chain->size - chain->head;
+        uint8_t **new_segments;
+
+        while (new_size < count)
+            new_size *= 2;
+
+        new_segments = (uint8_t **)spo_memory_alloc(pool->memory, new_size * sizeof(uint8_t *));
+        if (new_segments == NULL)
+            return SPO_FALSE;
+
+        /* the ring is unwrapped into the new array */
+        if (chain->segments != NULL)
+        {
+            if (head_segments >= chain->count)
+            {
+                memcpy(new_segments, chain->segments + chain->head, chain->count * sizeof(uint8_t *));
+            }
+            else
+            {
+                memcpy(new_segments, chain->segments + chain->head, head_segments * sizeof(uint8_t *));
+                memcpy(new_segments + head_segments, chain->segments, (chain->count - head_segments) * sizeof(uint8_t *));
+            }
+
+            spo_memory_free(pool->memory, chain->segments, chain->size * sizeof(uint8_t *));
+        }
+
+        chain->segments = new_segments;
+        chain->size = new_size;
+        chain->head = 0;
+    }
+
+    /* segments for the new part of the stream are allocated on write */
+    for (i = chain->count; i < count; ++i)
+        SPO_SEGMENT_CHAIN_AT(chain, i) = NULL;
+    chain->count = count;
+
+    return SPO_TRUE;
+}
+
+void spo_segment_chain_init(spo_segment_chain_t *chain)
+{
+    chain->segments = NULL;
+    chain->head = 0;
+    chain->count = 0;
+    chain->size = 0;
+    chain->head_offset = 0;
+}
+
+void spo_segment_chain_destroy(spo_segment_chain_t *chain, spo_segment_pool_t *pool)
+{
+    spo_segment_chain_clear(chain, pool);
+
+    if (chain->segments != NULL)
+        spo_memory_free(pool->memory, chain->segments, chain->size * sizeof(uint8_t *));
+
+    spo_segment_chain_init(chain);
+}
+
+uint32_t spo_segment_chain_write(spo_segment_chain_t *chain, spo_segment_pool_t *pool,
+    uint32_t offset, const uint8_t *data, uint32_t data_size, spo_bool_t use_reserve)
+{
+    uint32_t index;
+    uint32_t pos_in_segment;
+    uint32_t bytes_to_write;
+    uint8_t **segment;
+    uint32_t bytes_written = 0;
+    uint32_t pos = chain->head_offset + offset;
+
+    while (bytes_written < data_size)
+    {
+        index = pos / SPO_SEGMENT_SIZE;
+        pos_in_segment = pos % SPO_SEGMENT_SIZE;
+
+        if (index >= chain->count && spo_internal_extend_segment_chain(chain, pool, index + 1) == SPO_FALSE)
+            break;
+
+        segment = &SPO_SEGMENT_CHAIN_AT(chain, index);
+        if (*segment == NULL)
+        {
+            *segment = spo_segment_alloc(pool, use_reserve);
+            if (*segment == NULL)
+                break; /* only the head of the data is written */
+        }
+
+        bytes_to_write = SPO_MIN(SPO_SEGMENT_SIZE - pos_in_segment, data_size - bytes_written);
+        memcpy(*segment + pos_in_segment, data + bytes_written, bytes_to_write);
+
+        bytes_written += bytes_to_write;
+        pos += bytes_to_write;
+    }
+
+    return bytes_written;
+}
+
+void spo_segment_chain_read(const spo_segment_chain_t *chain, uint32_t offset, uint8_t *data, uint32_t data_size)
+{
+    uint32_t pos_in_segment;
+    uint32_t bytes_to_read;
+    uint32_t bytes_read = 0;
+    uint32_t pos = chain->head_offset + offset;
+
+    /* the caller reads only the data written before */
+    while (bytes_read < data_size)
+    {
+        pos_in_segment = pos % SPO_SEGMENT_SIZE;
+        bytes_to_read = SPO_MIN(SPO_SEGMENT_SIZE - pos_in_segment, data_size - bytes_read);
+
+        memcpy(data + bytes_read, SPO_SEGMENT_CHAIN_AT(chain, pos / SPO_SEGMENT_SIZE) + pos_in_segment, bytes_to_read);
+
+        bytes_read += bytes_to_read;
+        pos += bytes_to_read;
+    }
+}
+
+uint8_t *spo_segment_chain_get_data(const spo_segment_chain_t *chain, uint32_t offset, uint32_t *data_size)
+{
+    uint32_t pos = chain->head_offset + offset;
+    uint32_t pos_in_segment = pos % SPO_SEGMENT_SIZE;
+
+    /* the caller gets the data written before, up to the end of the segment */
+    *data_size = SPO_MIN(SPO_SEGMENT_SIZE - pos_in_segment, *data_size);
+    return SPO_SEGMENT_CHAIN_AT(chain, pos / SPO_SEGMENT_SIZE) + pos_in_segment;
+}
+
+void spo_segment_chain_consume(spo_segment_chain_t *chain, spo_segment_pool_t *pool, uint32_t bytes)
+{
+    uint32_t i;
+    uint32_t segments_consumed;
+
+    chain->head_offset += bytes;
+    segments_consumed = SPO_MIN(chain->head_offset / SPO_SEGMENT_SIZE, chain->count);
+
+    /* return fully consumed segments to the pool, the rest stay in place */
+    for (i = 0; i < segments_consumed; ++i)
+    {
+        if (SPO_SEGMENT_CHAIN_AT(chain, i) != NULL)
+            spo_segment_free(pool, SPO_SEGMENT_CHAIN_AT(chain, i));
+    }
+
+    if (chain->size > 0)
+        chain->head = (chain->head + segments_consumed) & (chain->size - 1);
+    chain->count -= segments_consumed;
+    chain->head_offset -= segments_consumed * SPO_SEGMENT_SIZE;
+}
+
+void spo_segment_chain_clear(spo_segment_chain_t *chain, spo_segment_pool_t *pool)
+{
+    uint32_t i;
+
+    /* release all the segments, but keep the array for the next data */
+    for (i = 0; i < chain->count; ++i)
+    {
+        if (SPO_SEGMENT_CHAIN_AT(chain, i) != NULL)
+            spo_segment_free(pool, SPO_SEGMENT_CHAIN_AT(chain, i));
+    }
+
+    chain->head = 0;
+    chain->count = 0;
+    chain->head_offset = 0;
+}
@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "siphash.h"
+#include "common.h"
+
+#define SPO_ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SPO_SIPROUND(v0, v1, v2, v3) \
+    do { \
+        v0 += v1; v1 = SPO_ROTL64(v1, 13); v1 ^= v0; v0 = SPO_ROTL64(v0, 32); \
+        v2 += v3; v3 = SPO_ROTL64(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = SPO_ROTL64(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = SPO_ROTL64(v1, 17); v1 ^= v2; v2 = SPO_ROTL64(v2, 32); \
+    } while (0)
+
+/* reads little-endian value regardless of the platform byte order */
+SPO_INLINE uint64_t spo_internal_read_8bytes(const uint8_t *data, uint32_t size)
+{
+    uint64_t value = 0;
+
+    while (size > 0)
+    {
+        --size;
+        value = (value << 8) | data[size];
+    }
+
+    return value;
+}
+
+uint64_t spo_siphash(const uint8_t *key, const uint8_t *data, uint32_t data_size)
+{
+    uint64_t k0 = spo_internal_read_8bytes(key, 8);
+    uint64_t k1 = spo_internal_read_8bytes(key + 8, 8);
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    uint64_t m;
+    uint32_t size = data_size;
+
+    while (size >= 8)
+    {
+        m = spo_internal_read_8bytes(data, 8);
+
+        v3 ^= m;
+        SPO_SIPROUND(v0, v1, v2, v3);
+        SPO_SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+
+        data += 8;
+        size -= 8;
+    }
+
+    /* the last block holds the rest of the data and the data size */
+    m = spo_internal_read_8bytes(data, size) | ((uint64_t)(data_size & 0xff) << 56);
+
+    v3 ^= m;
+    SPO_SIPROUND(v0, v1, v2, v3);
+    SPO_SIPROUND(v0, v1, v2, v3);
+    v0 ^= m;
+
+    v2 ^= 0xff;
+    SPO_SIPROUND(v0, v1, v2, v3);
+    SPO_SIPROUND(v0, v1, v2, v3);
+    SPO_SIPROUND(v0, v1, v2, v3);
+    SPO_SIPROUND(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
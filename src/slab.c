@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2015 drugaddicted - c17h19no3 AT openmailbox DOT org
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "slab.h"
+
+#define SPO_SLAB_CHUNK_SIZE(slab, items) (sizeof(spo_slab_chunk_t) + (slab)->item_alignment - 1 + (size_t)(items) * (slab)->item_size)
+
+SPO_INLINE spo_bool_t spo_internal_add_chunk(spo_slab_t *slab, uint32_t items)
+{
+    uint32_t i;
+    uint8_t *item;
+    spo_slab_chunk_t *chunk = (spo_slab_chunk_t *)spo_memory_alloc(slab->memory, SPO_SLAB_CHUNK_SIZE(slab, items));
+
+    if (chunk == NULL)
+        return SPO_FALSE;
+
+    chunk->next_chunk = slab->chunks;
+    chunk->items = items;
+    slab->chunks = chunk;
+
+    /* the allocator knows nothing about alignment of the items, so align the first one here */
+    item = (uint8_t *)(chunk + 1);
+    item += (slab->item_alignment - (size_t)item % slab->item_alignment) % slab->item_alignment;
+
+    /* push new items to the free list */
+    for (i = 0; i < items; ++i)
+    {
+        *(void **)item = slab->free_items;
+        slab->free_items = item;
+        item += slab->item_size;
+    }
+
+    slab->items_allocated += items;
+    return SPO_TRUE;
+}
+
+void spo_slab_init(spo_slab_t *slab, spo_memory_t *memory,
+    uint32_t item_size, uint32_t item_alignment, uint32_t items_per_chunk)
+{
+    /* free items are linked through their first bytes, so items can't be smaller than a pointer */
+    if (item_size < sizeof(void *))
+        item_size = sizeof(void *);
+    if (item_alignment < sizeof(void *))
+        item_alignment = sizeof(void *);
+
+    slab->memory = memory;
+    slab->free_items = NULL;
+    slab->chunks = NULL;
+    slab->item_alignment = item_alignment;
+    slab->item_size = (item_size + item_alignment - 1) / item_alignment * item_alignment;
+    slab->items_per_chunk = (items_per_chunk > 0) ? items_per_chunk : 1;
+    slab->items_allocated = 0;
+    slab->items_used = 0;
+}
+
+void spo_slab_destroy(spo_slab_t *slab)
+{
+    spo_slab_chunk_t *next;
+    spo_slab_chunk_t *current = slab->chunks;
+
+    while (current != NULL)
+    {
+        next = current->next_chunk;
+        spo_memory_free(slab->memory, current, SPO_SLAB_CHUNK_SIZE(slab, current->items));
+        current = next;
+    }
+
+    slab->free_items = NULL;
+    slab->chunks = NULL;
+    slab->items_allocated = 0;
+    slab->items_used = 0;
+}
+
+spo_bool_t spo_slab_reserve(spo_slab_t *slab, uint32_t items)
+{
+    uint32_t items_free = slab->items_allocated - slab->items_used;
+
+    if (items <= items_free)
+        return SPO_TRUE;
+
+    /* allocate all missing items at once */
+    return spo_internal_add_chunk(slab, items - items_free);
+}
+
+void *spo_slab_alloc(spo_slab_t *slab)
+{
+    void *item;
+
+    if (slab->free_items == NULL)
+    {
+        if (spo_internal_add_chunk(slab, slab->items_per_chunk) == SPO_FALSE)
+            return NULL;
+    }
+
+    item = slab->free_items;
+    slab->free_items = *(void **)item;
+
+    ++slab->items_used;
+    return item;
+}
+
+void spo_slab_free(spo_slab_t *slab, void *item)
+{
+    *(void **)item = slab->free_items;
+    slab->free_items = item;
+
+    --slab->items_used;
+}
@@ -27,29 +27,35 @@ THE SOFTWARE.
 #else
 #include <time.h>
 
-#define SPO_TIME_TO_MSECS(time) (uint32_t)((time).tv_sec * 1000 + (time).tv_nsec / 1000000)
+#define SPO_TIMESPEC_TO_USECS(time) ((spo_time_t)(time).tv_sec * 1000000 + (time).tv_nsec / 1000)
 #endif
 
-uint32_t spo_time_current()
+spo_time_t spo_time_now()
 {
 #ifdef _WIN32
-    return (uint32_t)GetTickCount();
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    /* split the conversion to avoid overflow of the multiplication */
+    return (spo_time_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+        (spo_time_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
 #else
     struct timespec ts;
     if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
-        return SPO_TIME_TO_MSECS(ts);
+        return SPO_TIMESPEC_TO_USECS(ts);
     return 0;
 #endif
 }
 
+uint32_t spo_time_current()
+{
+    return SPO_TIME_TO_MSECS(spo_time_now());
+}
+
 uint32_t spo_time_elapsed(uint32_t from_time)
 {
-#ifdef _WIN32
-    return ((uint32_t)GetTickCount() - from_time); /* unsigned arithmetic does all the magic */
-#else
-    struct timespec ts;
-    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
-        return (SPO_TIME_TO_MSECS(ts) - from_time); /* unsigned arithmetic does all the magic */
-    return 0;
-#endif
+    return (spo_time_current() - from_time); /* unsigned arithmetic does all the magic */
 }
@@ -34,6 +34,7 @@ THE SOFTWARE.
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <netinet/in.h>
@@ -55,8 +56,16 @@ typedef struct
 {
     spo_net_address_t bind_address;
     SPO_NET_SOCKET_TYPE handle;
+    spo_memory_t *memory;
 } spo_net_socket_data_t;
 
+/* goes with the socket handle to another process */
+typedef struct
+{
+    spo_net_address_t bind_address;
+    uint32_t data_size;
+} spo_net_socket_handoff_t;
+
 SPO_INLINE spo_bool_t spo_internal_set_socket_blocking_mode(SPO_NET_SOCKET_TYPE socket, spo_bool_t block)
 {
 #ifdef _WIN32
@@ -173,7 +182,7 @@ void spo_net_shutdown()
 #endif
 }
 
-spo_net_socket_t spo_net_new_socket(const spo_net_address_t *bind_address, uint32_t buf_size)
+spo_net_socket_t spo_net_new_socket(const spo_net_address_t *bind_address, uint32_t buf_size, spo_memory_t *memory)
 {
     int result;
     SPO_NET_SOCKET_TYPE handle;
@@ -208,7 +217,7 @@ spo_net_socket_t spo_net_new_socket(const spo_net_address_t *bind_address, uint3
         return NULL;
     }
 
-    data = (spo_net_socket_data_t *)malloc(sizeof(spo_net_socket_data_t));
+    data = (spo_net_socket_data_t *)spo_memory_alloc(memory, sizeof(spo_net_socket_data_t));
     if (data == NULL)
     {
         SPO_NET_CLOSE_SOCKET(handle);
@@ -217,6 +226,7 @@ spo_net_socket_t spo_net_new_socket(const spo_net_address_t *bind_address, uint3
 
     data->handle = handle;
     data->bind_address = *bind_address;
+    data->memory = memory;
     return data;
 }
 
@@ -246,7 +256,7 @@ void spo_net_close_socket(spo_net_socket_t socket)
     spo_net_socket_data_t *socket_data = (spo_net_socket_data_t *)socket;
 
     SPO_NET_CLOSE_SOCKET(socket_data->handle);
-    free(socket_data);
+    spo_memory_free(socket_data->memory, socket_data, sizeof(spo_net_socket_data_t));
 }
 
 uint32_t spo_net_recv(spo_net_socket_t socket, uint8_t *buf, uint32_t buf_size, spo_net_address_t *address)
@@ -283,3 +293,138 @@ uint32_t spo_net_send(spo_net_socket_t socket, const uint8_t *buf, uint32_t buf_
 
     return result;
 }
+
+#ifndef _WIN32
+
+SPO_INLINE spo_bool_t spo_internal_write_stream(int stream, const uint8_t *data, uint32_t data_size)
+{
+    ssize_t result;
+
+    while (data_size > 0)
+    {
+        result = write(stream, data, data_size);
+        if (result <= 0)
+            return SPO_FALSE;
+
+        data += result;
+        data_size -= (uint32_t)result;
+    }
+
+    return SPO_TRUE;
+}
+
+SPO_INLINE spo_bool_t spo_internal_read_stream(int stream, uint8_t *data, uint32_t data_size)
+{
+    ssize_t result;
+
+    while (data_size > 0)
+    {
+        result = read(stream, data, data_size);
+        if (result <= 0)
+            return SPO_FALSE;
+
+        data += result;
+        data_size -= (uint32_t)result;
+    }
+
+    return SPO_TRUE;
+}
+
+#endif
+
+spo_bool_t spo_net_send_socket(spo_net_socket_t socket, int unix_socket, const uint8_t *data, uint32_t data_size)
+{
+#ifdef _WIN32
+    return SPO_FALSE;
+#else
+    struct msghdr message;
+    struct iovec iov;
+    struct cmsghdr *control;
+    uint8_t control_data[CMSG_SPACE(sizeof(int))];
+    spo_net_socket_handoff_t handoff;
+    spo_net_socket_data_t *socket_data = (spo_net_socket_data_t *)socket;
+
+    memset(&handoff, 0, sizeof(handoff));
+    handoff.bind_address = socket_data->bind_address;
+    handoff.data_size = data_size;
+
+    iov.iov_base = &handoff;
+    iov.iov_len = sizeof(handoff);
+
+    /* the handle goes as the ancillary data of the header */
+    memset(&message, 0, sizeof(message));
+    memset(control_data, 0, sizeof(control_data));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control_data;
+    message.msg_controllen = sizeof(control_data);
+
+    control = CMSG_FIRSTHDR(&message);
+    control->cmsg_level = SOL_SOCKET;
+    control->cmsg_type = SCM_RIGHTS;
+    control->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(control), &socket_data->handle, sizeof(int));
+
+    if (sendmsg(unix_socket, &message, 0) != sizeof(handoff))
+        return SPO_FALSE;
+
+    return spo_internal_write_stream(unix_socket, data, data_size);
+#endif
+}
+
+spo_net_socket_t spo_net_receive_socket(int unix_socket, spo_memory_t *memory, uint8_t **data, uint32_t *data_size)
+{
+#ifdef _WIN32
+    return NULL;
+#else
+    struct msghdr message;
+    struct iovec iov;
+    struct cmsghdr *control;
+    uint8_t control_data[CMSG_SPACE(sizeof(int))];
+    spo_net_socket_handoff_t handoff;
+    spo_net_socket_data_t *socket_data;
+    SPO_NET_SOCKET_TYPE handle;
+
+    iov.iov_base = &handoff;
+    iov.iov_len = sizeof(handoff);
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control_data;
+    message.msg_controllen = sizeof(control_data);
+
+    if (recvmsg(unix_socket, &message, 0) != sizeof(handoff))
+        return NULL;
+
+    control = CMSG_FIRSTHDR(&message);
+    if (control == NULL || control->cmsg_level != SOL_SOCKET || control->cmsg_type != SCM_RIGHTS)
+        return NULL;
+
+    memcpy(&handle, CMSG_DATA(control), sizeof(int));
+
+    *data_size = handoff.data_size;
+    *data = (uint8_t *)spo_memory_alloc(memory, handoff.data_size);
+    if (*data == NULL)
+    {
+        SPO_NET_CLOSE_SOCKET(handle);
+        return NULL;
+    }
+
+    socket_data = (spo_net_socket_data_t *)spo_memory_alloc(memory, sizeof(spo_net_socket_data_t));
+    if (socket_data == NULL || spo_internal_read_stream(unix_socket, *data, handoff.data_size) == SPO_FALSE)
+    {
+        if (socket_data != NULL)
+            spo_memory_free(memory, socket_data, sizeof(spo_net_socket_data_t));
+        spo_memory_free(memory, *data, handoff.data_size);
+        SPO_NET_CLOSE_SOCKET(handle);
+        return NULL;
+    }
+
+    /* the handle keeps the receive buffer size and non-blocking mode of the previous owner */
+    socket_data->handle = handle;
+    socket_data->bind_address = handoff.bind_address;
+    socket_data->memory = memory;
+    return socket_data;
+#endif
+}
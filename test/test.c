@@ -162,6 +162,7 @@ int main(int argc, char **argv)
     configuration.connection_buf_size = SPO_RWND_SIZE;
     configuration.socket_buf_size = 1048576 * 4;
     configuration.max_connections = 500;
+    configuration.preallocate_connections = 0;
     configuration.connection_timeout = 8000;
     configuration.ping_interval = 1500;
     configuration.connect_retransmission_timeout = 2000;
@@ -171,6 +172,17 @@ int main(int argc, char **argv)
     configuration.data_retransmission_timeout = 600;
     configuration.skip_packets_before_acknowledgement = 0;
     configuration.max_consecutive_acknowledges = 10;
+    configuration.hibernation_timeout = 30000;
+    configuration.buffers_memory_limit = 0;
+    configuration.use_hugepages = 0;
+    configuration.connect_cookies_threshold = 64;
+    configuration.max_resets_per_second = 1000;
+    configuration.max_resets_per_source = 10;
+    configuration.max_connects_per_source = 10;
+    configuration.max_connects_per_second = 1000;
+    configuration.max_connects_in_flight = 64;
+    configuration.allow_migration = 1;
+    configuration.receive_bitmap = 0;
 
     host = spo_new_host(&bind_addr1, &configuration, &callbacks);
     if (host == NULL)